@@ -10,29 +10,12 @@
 #include <unistd.h>
 #endif
 
+#include "catalog.h"
 #include "helpers.h"
 
 #define E2E_PRODUCTS_FILE "products.csv"
 
-typedef struct {
-    char ProductID[20];
-    char ProductName[100];
-    int Quantity;
-    int UnitPrice;
-} Product;
-
-extern Product *products;
-extern int product_count;
-extern int product_capacity;
-
-int ensure_csv_exists(const char *filename);
-int load_csv(const char *filename);
-int save_csv(const char *filename);
-int add_product(const char *ProductID, const char *ProductName, int Quantity, int UnitPrice);
-int update_product(const char *ProductID, const char *ProductName, int Quantity, int UnitPrice);
-int remove_product(const char *ProductID);
-int find_products_by_keyword(const char *keyword, int **out_matches);
-void menu_product_manager(void);
+void menu_product_manager(Catalog **catalogs, int catalog_count);
 
 typedef struct {
     MenuKey key;
@@ -179,69 +162,18 @@ static void scripted_clear_screen(void) {
     /* Suppress terminal clear in scripted tests */
 }
 
-typedef struct {
-    Product *original_products;
-    Product *snapshot;
-    int original_count;
-    int original_capacity;
-} ProductStateBackup;
-
 typedef struct {
     char *data;
     size_t size;
     int existed;
 } FileBackup;
 
-static int backup_product_state(ProductStateBackup *backup) {
-    if (!backup) {
-        return -1;
-    }
-
-    backup->original_products = products;
-    backup->original_count = product_count;
-    backup->original_capacity = product_capacity;
-    backup->snapshot = NULL;
-
-    if (products && product_capacity > 0) {
-        backup->snapshot = (Product *)malloc((size_t)product_capacity * sizeof(Product));
-        if (!backup->snapshot) {
-            return -1;
-        }
-        memcpy(backup->snapshot, products, (size_t)product_capacity * sizeof(Product));
-    }
-
-    products = NULL;
-    product_count = 0;
-    product_capacity = 0;
-
-    return 0;
-}
-
-static void restore_product_state(ProductStateBackup *backup) {
-    if (!backup) {
-        return;
-    }
-
-    free(products);
-    products = backup->original_products;
-    product_count = backup->original_count;
-    product_capacity = backup->original_capacity;
-
-    if (backup->snapshot && backup->original_products && backup->original_capacity > 0) {
-        memcpy(backup->original_products,
-               backup->snapshot,
-               (size_t)backup->original_capacity * sizeof(Product));
-    }
-
-    free(backup->snapshot);
-    backup->snapshot = NULL;
-}
-
-static void reset_e2e_environment(void) {
-    free(products);
-    products = NULL;
-    product_count = 0;
-    product_capacity = 0;
+static void reset_e2e_environment(Catalog *catalog) {
+    free(catalog->products);
+    catalog->products = NULL;
+    catalog->product_count = 0;
+    catalog->product_capacity = 0;
+    catalog_indexes_invalidate(catalog);
 }
 
 static int backup_products_file(FileBackup *backup, const char *path) {
@@ -336,7 +268,7 @@ cleanup:
     return result;
 }
 
-static int scenario_full_user_journey(void) {
+static int scenario_full_user_journey(Catalog *catalog) {
     static const MenuScriptEvent script_events[] = {
         {MENU_KEY_ENTER, -1, '\0'},            /* select add product */
         {MENU_KEY_UP, -1, '\0'},               /* focus add product again */
@@ -375,7 +307,7 @@ static int scenario_full_user_journey(void) {
         "y"
     };
 
-    reset_e2e_environment();
+    reset_e2e_environment(catalog);
 
     if (remove(E2E_PRODUCTS_FILE) != 0 && errno != ENOENT) {
         printf("    Failed to reset %s\n", E2E_PRODUCTS_FILE);
@@ -387,13 +319,13 @@ static int scenario_full_user_journey(void) {
         return 1;
     }
 
-    if (load_csv(E2E_PRODUCTS_FILE) != 0) {
+    if (load_csv(catalog, E2E_PRODUCTS_FILE) != 0) {
         printf("    load_csv failed on empty catalog\n");
         return 1;
     }
 
-    if (product_count != 0) {
-        printf("    Expected empty catalog after load, got %d items\n", product_count);
+    if (catalog->product_count != 0) {
+        printf("    Expected empty catalog after load, got %d items\n", catalog->product_count);
         return 1;
     }
 
@@ -414,12 +346,14 @@ static int scenario_full_user_journey(void) {
         scripted_read_menu_key,
         scripted_read_line_allow_ctrl,
         scripted_wait_for_enter,
-        scripted_clear_screen
+        scripted_clear_screen,
+        NULL,
+        NULL
     };
 
     helpers_set_hooks(&hooks);
 
-    menu_product_manager();
+    menu_product_manager(&catalog, 1);
 
     helpers_set_hooks(NULL);
 
@@ -443,41 +377,41 @@ static int scenario_full_user_journey(void) {
         return 1;
     }
 
-    if (product_count != 1) {
+    if (catalog->product_count != 1) {
         printf("    Expected catalog to contain 1 product after scripted session, got %d.\n",
-               product_count);
+               catalog->product_count);
         return 1;
     }
 
-    if (strcmp(products[0].ProductID, "E2E002") != 0 ||
-        strcmp(products[0].ProductName, "E2E Precision Mouse Pro") != 0 ||
-        products[0].Quantity != 25 ||
-        products[0].UnitPrice != 2490) {
+    if (strcmp(catalog->products[0].ProductID, "E2E002") != 0 ||
+        strcmp(catalog->products[0].ProductName, "E2E Precision Mouse Pro") != 0 ||
+        catalog->products[0].Quantity != 25 ||
+        catalog->products[0].UnitPrice != 2490) {
         printf("    Final product state did not match expectations.\n");
         return 1;
     }
 
-    reset_e2e_environment();
-    if (load_csv(E2E_PRODUCTS_FILE) != 0) {
+    reset_e2e_environment(catalog);
+    if (load_csv(catalog, E2E_PRODUCTS_FILE) != 0) {
         printf("    load_csv failed to reload persisted catalog\n");
         return 1;
     }
 
-    if (product_count != 1) {
-        printf("    Expected 1 product after reload, got %d\n", product_count);
+    if (catalog->product_count != 1) {
+        printf("    Expected 1 product after reload, got %d\n", catalog->product_count);
         return 1;
     }
 
-    if (strcmp(products[0].ProductID, "E2E002") != 0 ||
-        strcmp(products[0].ProductName, "E2E Precision Mouse Pro") != 0 ||
-        products[0].Quantity != 25 ||
-        products[0].UnitPrice != 2490) {
+    if (strcmp(catalog->products[0].ProductID, "E2E002") != 0 ||
+        strcmp(catalog->products[0].ProductName, "E2E Precision Mouse Pro") != 0 ||
+        catalog->products[0].Quantity != 25 ||
+        catalog->products[0].UnitPrice != 2490) {
         printf("    Persisted data did not match expected values\n");
         return 1;
     }
 
     int *matches = NULL;
-    int match_count = find_products_by_keyword("pro", &matches);
+    int match_count = find_products_by_keyword(catalog, "pro", &matches);
     if (match_count != 1) {
         printf("    Expected keyword search on persisted data to return 1 item, got %d\n", match_count);
         free(matches);
@@ -488,7 +422,7 @@ static int scenario_full_user_journey(void) {
     return 0;
 }
 
-typedef int (*E2EScenario)(void);
+typedef int (*E2EScenario)(Catalog *catalog);
 
 typedef struct {
     const char *name;
@@ -498,17 +432,10 @@ typedef struct {
 int run_e2e_tests(void) {
     g_script_step_mode = 1;
 
-    ProductStateBackup state_backup;
     FileBackup file_backup;
 
-    if (backup_product_state(&state_backup) != 0) {
-        printf("Failed to back up product state.\n");
-        return 1;
-    }
-
     if (backup_products_file(&file_backup, E2E_PRODUCTS_FILE) != 0) {
         printf("Failed to back up %s.\n", E2E_PRODUCTS_FILE);
-        restore_product_state(&state_backup);
         return 1;
     }
 
@@ -522,18 +449,22 @@ int run_e2e_tests(void) {
     if (!results) {
         printf("Failed to allocate memory for results.\n");
         restore_products_file(&file_backup, E2E_PRODUCTS_FILE);
-        restore_product_state(&state_backup);
         g_script_step_mode = 0;
         return 1;
     }
 
     printf("\n\033[1mStarting step-by-step replay...\033[0m\n\n");
 
+    // Scenarios drive a menu over a catalog of their own, leaving the caller's untouched
     for (size_t i = 0; i < scenario_count; i++) {
-        reset_e2e_environment();
+        Catalog catalog;
+        catalog_init(&catalog);
+        catalog_configure(&catalog, E2E_PRODUCTS_FILE, 0);
         printf("\033[1;34mScenario:\033[0m %s\n", scenarios[i].name);
 
-        int rc = scenarios[i].func();
+        int rc = scenarios[i].func(&catalog);
+        catalog_rollback(&catalog);
+        catalog_free(&catalog);
         results[i] = rc;
 
         if (rc == 0) {
@@ -547,14 +478,10 @@ int run_e2e_tests(void) {
         }
     }
 
-    reset_e2e_environment();
-
     if (restore_products_file(&file_backup, E2E_PRODUCTS_FILE) != 0) {
         printf("Warning: Failed to restore %s.\n", E2E_PRODUCTS_FILE);
     }
 
-    restore_product_state(&state_backup);
-
     printf("\n\033[1mResult breakdown:\033[0m\n");
     for (size_t i = 0; i < scenario_count; i++) {
         const char *status = (results[i] == 0) ? "PASS" : "FAIL";
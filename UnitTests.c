@@ -1,32 +1,40 @@
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <errno.h>
 #include <limits.h>
-
-// Dedicated unit tests for add_product and update_product helpers.
+#include <pthread.h>
+
+#include "art.h"
+#include "catalog.h"
+#include "event_loop.h"
+#include "file_watch.h"
+#include "dfa.h"
+#include "fuzzy.h"
+#include "helpers.h"
+#include "ostree.h"
+#include "parallel.h"
+#include "query.h"
+#include "screen.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+// Dedicated unit tests for add_product, update_product and catalog transactions.
 #define TEST_PRODUCTS_FILE "products.csv"
+#define TEST_SHARD_BASE "ut_shards.csv"
+#define TEST_SHARD_COUNT 4
+#define TEST_EXPORT_FILE "ut_shards_export.csv"
+#define TEST_SORTED_FILE "ut_sorted_export.csv"
+#define TEST_PARALLEL_FILE "ut_parallel.csv"
+#define TEST_SECOND_FILE "ut_second.csv"
+#define TEST_COMMANDS_FILE "ut_commands.txt"
 
-typedef struct {
-    char ProductID[20];
-    char ProductName[100];
-    int Quantity;
-    int UnitPrice;
-} Product;
-
-extern Product *products;
-extern int product_count;
-extern int product_capacity;
-
-int add_product(const char *ProductID, const char *ProductName, int Quantity, int UnitPrice);
-int update_product(const char *ProductID, const char *ProductName, int Quantity, int UnitPrice);
-
-typedef struct {
-    Product *original_products;
-    Product *snapshot;
-    int original_count;
-    int original_capacity;
-} ProductStateBackup;
+void menu_product_manager(Catalog **catalogs, int catalog_count);
 
 typedef struct {
     char *data;
@@ -34,57 +42,13 @@ typedef struct {
     int existed;
 } FileBackup;
 
-// Capture global buffers so every test starts from a clean slate.
-static int backup_product_state(ProductStateBackup *backup) {
-    if (!backup) {
-        return -1;
-    }
-
-    backup->original_products = products;
-    backup->original_count = product_count;
-    backup->original_capacity = product_capacity;
-    backup->snapshot = NULL;
-
-    if (products && product_capacity > 0) {
-        backup->snapshot = (Product *)malloc((size_t)product_capacity * sizeof(Product));
-        if (!backup->snapshot) {
-            return -1;
-        }
-        memcpy(backup->snapshot, products, (size_t)product_capacity * sizeof(Product));
-    }
-
-    products = NULL;
-    product_count = 0;
-    product_capacity = 0;
-
-    return 0;
-}
-
-static void restore_product_state(ProductStateBackup *backup) {
-    if (!backup) {
-        return;
-    }
-
-    free(products);
-    products = backup->original_products;
-    product_count = backup->original_count;
-    product_capacity = backup->original_capacity;
-
-    if (backup->snapshot && backup->original_products && backup->original_capacity > 0) {
-        memcpy(backup->original_products,
-               backup->snapshot,
-               (size_t)backup->original_capacity * sizeof(Product));
-    }
-
-    free(backup->snapshot);
-    backup->snapshot = NULL;
-}
-
-static void reset_test_environment(void) {
-    free(products);
-    products = NULL;
-    product_count = 0;
-    product_capacity = 0;
+static void reset_test_environment(Catalog *catalog) {
+    catalog_rollback(catalog);
+    free(catalog->products);
+    catalog->products = NULL;
+    catalog->product_count = 0;
+    catalog->product_capacity = 0;
+    catalog_indexes_invalidate(catalog);
 }
 
 // Preserve the on-disk catalog to avoid clobbering user data while testing.
@@ -180,25 +144,25 @@ cleanup:
     return result;
 }
 
-static int test_add_product_inserts_new_entry(void) {
-    int rc = add_product("UT001", "Test Widget", 5, 100);
+static int test_add_product_inserts_new_entry(Catalog *catalog) {
+    int rc = add_product(catalog, "UT001", "Test Widget", 5, 100);
     if (rc != 0) {
         printf("    Expected add_product success, got %d\n", rc);
         return 1;
     }
-    if (product_count != 1) {
-        printf("    Expected product_count 1, got %d\n", product_count);
+    if (catalog->product_count != 1) {
+        printf("    Expected product_count 1, got %d\n", catalog->product_count);
         return 1;
     }
-    if (product_capacity < 1) {
-        printf("    Expected product_capacity >= 1, got %d\n", product_capacity);
+    if (catalog->product_capacity < 1) {
+        printf("    Expected product_capacity >= 1, got %d\n", catalog->product_capacity);
         return 1;
     }
-    if (!products) {
+    if (!catalog->products) {
         printf("    Products array is NULL after insertion\n");
         return 1;
     }
-    Product *added = &products[0];
+    Product *added = &catalog->products[0];
     if (strcmp(added->ProductID, "UT001") != 0) {
         printf("    ProductID mismatch: %s\n", added->ProductID);
         return 1;
@@ -214,53 +178,53 @@ static int test_add_product_inserts_new_entry(void) {
     return 0;
 }
 
-static int test_add_product_rejects_duplicate_id(void) {
-    int rc = add_product("UT002", "Initial", 10, 200);
+static int test_add_product_rejects_duplicate_id(Catalog *catalog) {
+    int rc = add_product(catalog, "UT002", "Initial", 10, 200);
     if (rc != 0) {
         printf("    Failed to seed product for duplicate test\n");
         return 1;
     }
-    rc = add_product("UT002", "Duplicate", 5, 50);
+    rc = add_product(catalog, "UT002", "Duplicate", 5, 50);
     if (rc != 1) {
         printf("    Expected duplicate add_product to return 1, got %d\n", rc);
         return 1;
     }
-    if (product_count != 1) {
-        printf("    Product count changed after duplicate attempt: %d\n", product_count);
+    if (catalog->product_count != 1) {
+        printf("    Product count changed after duplicate attempt: %d\n", catalog->product_count);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "Initial") != 0 ||
-        products[0].Quantity != 10 ||
-        products[0].UnitPrice != 200) {
+    if (strcmp(catalog->products[0].ProductName, "Initial") != 0 ||
+        catalog->products[0].Quantity != 10 ||
+        catalog->products[0].UnitPrice != 200) {
         printf("    Existing product mutated after duplicate attempt\n");
         return 1;
     }
     return 0;
 }
 
-static int test_add_product_expands_capacity(void) {
+static int test_add_product_expands_capacity(Catalog *catalog) {
     const int to_insert = 15; // exceeds default allocation (10)
     for (int i = 0; i < to_insert; i++) {
         char id[20];
         char name[100];
         snprintf(id, sizeof(id), "CAP%03d", i);
         snprintf(name, sizeof(name), "Capacity Test %d", i);
-        if (add_product(id, name, i, i * 10) != 0) {
+        if (add_product(catalog, id, name, i, i * 10) != 0) {
             printf("    add_product failed at index %d\n", i);
             return 1;
         }
     }
 
-    if (product_count != to_insert) {
-        printf("    Expected %d products, got %d\n", to_insert, product_count);
+    if (catalog->product_count != to_insert) {
+        printf("    Expected %d products, got %d\n", to_insert, catalog->product_count);
         return 1;
     }
-    if (product_capacity < to_insert) {
-        printf("    Expected product_capacity >= %d, got %d\n", to_insert, product_capacity);
+    if (catalog->product_capacity < to_insert) {
+        printf("    Expected product_capacity >= %d, got %d\n", to_insert, catalog->product_capacity);
         return 1;
     }
 
-    Product *last = &products[to_insert - 1];
+    Product *last = &catalog->products[to_insert - 1];
     if (strcmp(last->ProductID, "CAP014") != 0 ||
         strcmp(last->ProductName, "Capacity Test 14") != 0 ||
         last->Quantity != 14 ||
@@ -272,83 +236,83 @@ static int test_add_product_expands_capacity(void) {
     return 0;
 }
 
-static int test_add_product_accepts_zero_values(void) {
-    int rc = add_product("UT011", "ZeroCase", 0, 0);
+static int test_add_product_accepts_zero_values(Catalog *catalog) {
+    int rc = add_product(catalog, "UT011", "ZeroCase", 0, 0);
     if (rc != 0) {
         printf("    Expected add_product success with zero values, got %d\n", rc);
         return 1;
     }
-    if (product_count != 1) {
-        printf("    Expected product_count 1, got %d\n", product_count);
+    if (catalog->product_count != 1) {
+        printf("    Expected product_count 1, got %d\n", catalog->product_count);
         return 1;
     }
-    if (!products) {
+    if (!catalog->products) {
         printf("    Products array is NULL after zero-value insertion\n");
         return 1;
     }
-    if (products[0].Quantity != 0 || products[0].UnitPrice != 0) {
-        printf("    Zero values not stored correctly: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != 0 || catalog->products[0].UnitPrice != 0) {
+        printf("    Zero values not stored correctly: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
     return 0;
 }
 
-static int test_add_product_handles_large_values(void) {
-    int rc = add_product("UT012", "MaxCase", INT_MAX, INT_MAX);
+static int test_add_product_handles_large_values(Catalog *catalog) {
+    int rc = add_product(catalog, "UT012", "MaxCase", INT_MAX, INT_MAX);
     if (rc != 0) {
         printf("    Expected add_product success with INT_MAX values, got %d\n", rc);
         return 1;
     }
-    if (product_count != 1) {
-        printf("    Expected product_count 1, got %d\n", product_count);
+    if (catalog->product_count != 1) {
+        printf("    Expected product_count 1, got %d\n", catalog->product_count);
         return 1;
     }
-    if (!products) {
+    if (!catalog->products) {
         printf("    Products array is NULL after INT_MAX insertion\n");
         return 1;
     }
-    if (products[0].Quantity != INT_MAX || products[0].UnitPrice != INT_MAX) {
-        printf("    INT_MAX values not stored correctly: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != INT_MAX || catalog->products[0].UnitPrice != INT_MAX) {
+        printf("    INT_MAX values not stored correctly: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
     return 0;
 }
 
-static int test_add_product_rejects_empty_name(void) {
-    int rc = add_product("UT013", "", 1, 1);
+static int test_add_product_rejects_empty_name(Catalog *catalog) {
+    int rc = add_product(catalog, "UT013", "", 1, 1);
     if (rc != 1) {
         printf("    Expected add_product to reject empty name, got %d\n", rc);
         return 1;
     }
-    if (product_count != 0) {
-        printf("    Product count should remain 0 after rejection, got %d\n", product_count);
+    if (catalog->product_count != 0) {
+        printf("    Product count should remain 0 after rejection, got %d\n", catalog->product_count);
         return 1;
     }
-    if (products != NULL) {
+    if (catalog->products != NULL) {
         printf("    Products array should remain NULL after rejection\n");
         return 1;
     }
     return 0;
 }
 
-static int test_add_product_rejects_whitespace_name(void) {
-    int rc = add_product("UT014", "   \t", 1, 1);
+static int test_add_product_rejects_whitespace_name(Catalog *catalog) {
+    int rc = add_product(catalog, "UT014", "   \t", 1, 1);
     if (rc != 1) {
         printf("    Expected add_product to reject whitespace name, got %d\n", rc);
         return 1;
     }
-    if (product_count != 0) {
-        printf("    Product count should remain 0 after whitespace rejection, got %d\n", product_count);
+    if (catalog->product_count != 0) {
+        printf("    Product count should remain 0 after whitespace rejection, got %d\n", catalog->product_count);
         return 1;
     }
-    if (products != NULL) {
+    if (catalog->products != NULL) {
         printf("    Products array should remain NULL after whitespace rejection\n");
         return 1;
     }
     return 0;
 }
 
-static int test_add_product_handles_max_length_strings(void) {
+static int test_add_product_handles_max_length_strings(Catalog *catalog) {
     char long_id[20];
     char long_name[100];
     for (int i = 0; i < 19; i++) {
@@ -361,36 +325,36 @@ static int test_add_product_handles_max_length_strings(void) {
     }
     long_name[99] = '\0';
 
-    int rc = add_product(long_id, long_name, 9, 99);
+    int rc = add_product(catalog, long_id, long_name, 9, 99);
     if (rc != 0) {
         printf("    Expected add_product success with max-length strings, got %d\n", rc);
         return 1;
     }
-    if (product_count != 1) {
-        printf("    Expected product_count 1, got %d\n", product_count);
+    if (catalog->product_count != 1) {
+        printf("    Expected product_count 1, got %d\n", catalog->product_count);
         return 1;
     }
-    if (!products) {
+    if (!catalog->products) {
         printf("    Products array is NULL after max-length insertion\n");
         return 1;
     }
-    if (strcmp(products[0].ProductID, long_id) != 0) {
+    if (strcmp(catalog->products[0].ProductID, long_id) != 0) {
         printf("    ProductID not preserved for max-length case\n");
         return 1;
     }
-    if (strcmp(products[0].ProductName, long_name) != 0) {
+    if (strcmp(catalog->products[0].ProductName, long_name) != 0) {
         printf("    ProductName not preserved for max-length case\n");
         return 1;
     }
-    if (products[0].Quantity != 9 || products[0].UnitPrice != 99) {
-        printf("    Quantity/UnitPrice not stored correctly: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != 9 || catalog->products[0].UnitPrice != 99) {
+        printf("    Quantity/UnitPrice not stored correctly: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
     return 0;
 }
 
-static int test_add_product_persists_to_csv(void) {
-    int rc = add_product("UT010", "Persist", 3, 30);
+static int test_add_product_persists_to_csv(Catalog *catalog) {
+    int rc = add_product(catalog, "UT010", "Persist", 3, 30);
     if (rc != 0) {
         printf("    Expected add_product success, got %d\n", rc);
         return 1;
@@ -438,44 +402,44 @@ static int test_add_product_persists_to_csv(void) {
     return 0;
 }
 
-static int test_add_product_appends_after_manual_seed(void) {
-    products = (Product *)malloc(3 * sizeof(Product));
-    if (!products) {
+static int test_add_product_appends_after_manual_seed(Catalog *catalog) {
+    catalog->products = (Product *)malloc(3 * sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 3;
-    product_count = 2;
+    catalog->product_capacity = 3;
+    catalog->product_count = 2;
 
-    strcpy(products[0].ProductID, "UT020");
-    strcpy(products[0].ProductName, "SeedOne");
-    products[0].Quantity = 2;
-    products[0].UnitPrice = 20;
+    strcpy(catalog->products[0].ProductID, "UT020");
+    strcpy(catalog->products[0].ProductName, "SeedOne");
+    catalog->products[0].Quantity = 2;
+    catalog->products[0].UnitPrice = 20;
 
-    strcpy(products[1].ProductID, "UT021");
-    strcpy(products[1].ProductName, "SeedTwo");
-    products[1].Quantity = 4;
-    products[1].UnitPrice = 40;
+    strcpy(catalog->products[1].ProductID, "UT021");
+    strcpy(catalog->products[1].ProductName, "SeedTwo");
+    catalog->products[1].Quantity = 4;
+    catalog->products[1].UnitPrice = 40;
 
-    int add_rc = add_product("UT022", "SeedThree", 6, 60);
+    int add_rc = add_product(catalog, "UT022", "SeedThree", 6, 60);
     if (add_rc != 0) {
         printf("    add_product failed while appending: %d\n", add_rc);
         return 1;
     }
-    if (product_count != 3) {
-        printf("    Expected product_count 3, got %d\n", product_count);
+    if (catalog->product_count != 3) {
+        printf("    Expected product_count 3, got %d\n", catalog->product_count);
         return 1;
     }
-    if (product_capacity != 3) {
-        printf("    Expected product_capacity to remain 3, got %d\n", product_capacity);
+    if (catalog->product_capacity != 3) {
+        printf("    Expected product_capacity to remain 3, got %d\n", catalog->product_capacity);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "SeedOne") != 0 ||
-        strcmp(products[1].ProductName, "SeedTwo") != 0) {
+    if (strcmp(catalog->products[0].ProductName, "SeedOne") != 0 ||
+        strcmp(catalog->products[1].ProductName, "SeedTwo") != 0) {
         printf("    Existing products mutated during append\n");
         return 1;
     }
-    Product *added = &products[2];
+    Product *added = &catalog->products[2];
     if (strcmp(added->ProductID, "UT022") != 0 ||
         strcmp(added->ProductName, "SeedThree") != 0 ||
         added->Quantity != 6 ||
@@ -487,232 +451,232 @@ static int test_add_product_appends_after_manual_seed(void) {
     return 0;
 }
 
-static int test_update_product_changes_fields(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_changes_fields(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT003");
-    strcpy(products[0].ProductName, "Original");
-    products[0].Quantity = 1;
-    products[0].UnitPrice = 10;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT003");
+    strcpy(catalog->products[0].ProductName, "Original");
+    catalog->products[0].Quantity = 1;
+    catalog->products[0].UnitPrice = 10;
 
-    int rc = update_product("UT003", "Updated", 25, 500);
+    int rc = update_product(catalog, "UT003", "Updated", 25, 500);
     if (rc != 0) {
         printf("    Expected update_product success, got %d\n", rc);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "Updated") != 0) {
-        printf("    ProductName not updated: %s\n", products[0].ProductName);
+    if (strcmp(catalog->products[0].ProductName, "Updated") != 0) {
+        printf("    ProductName not updated: %s\n", catalog->products[0].ProductName);
         return 1;
     }
-    if (products[0].Quantity != 25 || products[0].UnitPrice != 500) {
-        printf("    Quantity/UnitPrice not updated: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != 25 || catalog->products[0].UnitPrice != 500) {
+        printf("    Quantity/UnitPrice not updated: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
-    if (strcmp(products[0].ProductID, "UT003") != 0) {
+    if (strcmp(catalog->products[0].ProductID, "UT003") != 0) {
         printf("    ProductID unexpectedly changed\n");
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_handles_partial_updates(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_handles_partial_updates(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT004");
-    strcpy(products[0].ProductName, "KeepName");
-    products[0].Quantity = 7;
-    products[0].UnitPrice = 70;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT004");
+    strcpy(catalog->products[0].ProductName, "KeepName");
+    catalog->products[0].Quantity = 7;
+    catalog->products[0].UnitPrice = 70;
 
-    int rc = update_product("UT004", NULL, -1, 90);
+    int rc = update_product(catalog, "UT004", NULL, -1, 90);
     if (rc != 0) {
         printf("    Expected update_product success, got %d\n", rc);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "KeepName") != 0) {
+    if (strcmp(catalog->products[0].ProductName, "KeepName") != 0) {
         printf("    ProductName should remain unchanged\n");
         return 1;
     }
-    if (products[0].Quantity != 7) {
-        printf("    Quantity should remain unchanged: %d\n", products[0].Quantity);
+    if (catalog->products[0].Quantity != 7) {
+        printf("    Quantity should remain unchanged: %d\n", catalog->products[0].Quantity);
         return 1;
     }
-    if (products[0].UnitPrice != 90) {
-        printf("    UnitPrice should update to 90: %d\n", products[0].UnitPrice);
+    if (catalog->products[0].UnitPrice != 90) {
+        printf("    UnitPrice should update to 90: %d\n", catalog->products[0].UnitPrice);
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_missing_id_fails(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_missing_id_fails(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT005");
-    strcpy(products[0].ProductName, "Original");
-    products[0].Quantity = 1;
-    products[0].UnitPrice = 10;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT005");
+    strcpy(catalog->products[0].ProductName, "Original");
+    catalog->products[0].Quantity = 1;
+    catalog->products[0].UnitPrice = 10;
 
-    int rc = update_product("UNKNOWN", "Won't Matter", 2, 20);
+    int rc = update_product(catalog, "UNKNOWN", "Won't Matter", 2, 20);
     if (rc != 1) {
         printf("    Expected update_product to fail for missing ID, got %d\n", rc);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "Original") != 0 || products[0].Quantity != 1 || products[0].UnitPrice != 10) {
+    if (strcmp(catalog->products[0].ProductName, "Original") != 0 || catalog->products[0].Quantity != 1 || catalog->products[0].UnitPrice != 10) {
         printf("    Product data changed unexpectedly\n");
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_empty_inventory_fails(void) {
-    int rc = update_product("UT999", "Nope", 1, 1);
+static int test_update_product_empty_inventory_fails(Catalog *catalog) {
+    int rc = update_product(catalog, "UT999", "Nope", 1, 1);
     if (rc != 1) {
         printf("    Expected failure when inventory empty, got %d\n", rc);
         return 1;
     }
-    if (products != NULL || product_count != 0 || product_capacity != 0) {
+    if (catalog->products != NULL || catalog->product_count != 0 || catalog->product_capacity != 0) {
         printf("    Inventory state should remain empty\n");
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_handles_max_values(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_handles_max_values(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT033");
-    strcpy(products[0].ProductName, "MaxTarget");
-    products[0].Quantity = 1;
-    products[0].UnitPrice = 1;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT033");
+    strcpy(catalog->products[0].ProductName, "MaxTarget");
+    catalog->products[0].Quantity = 1;
+    catalog->products[0].UnitPrice = 1;
 
-    int rc = update_product("UT033", "MaxTarget", INT_MAX, INT_MAX);
+    int rc = update_product(catalog, "UT033", "MaxTarget", INT_MAX, INT_MAX);
     if (rc != 0) {
         printf("    Expected update_product success with INT_MAX values, got %d\n", rc);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "MaxTarget") != 0) {
+    if (strcmp(catalog->products[0].ProductName, "MaxTarget") != 0) {
         printf("    Product name should remain MaxTarget\n");
         return 1;
     }
-    if (products[0].Quantity != INT_MAX || products[0].UnitPrice != INT_MAX) {
-        printf("    INT_MAX values not stored correctly during update: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != INT_MAX || catalog->products[0].UnitPrice != INT_MAX) {
+        printf("    INT_MAX values not stored correctly during update: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_rejects_negative_numbers(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_rejects_negative_numbers(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT034");
-    strcpy(products[0].ProductName, "NegTarget");
-    products[0].Quantity = 12;
-    products[0].UnitPrice = 120;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT034");
+    strcpy(catalog->products[0].ProductName, "NegTarget");
+    catalog->products[0].Quantity = 12;
+    catalog->products[0].UnitPrice = 120;
 
-    int rc = update_product("UT034", "NegTarget", -10, -20);
+    int rc = update_product(catalog, "UT034", "NegTarget", -10, -20);
     if (rc != 0) {
         printf("    Expected update_product success when skipping negative updates, got %d\n", rc);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "NegTarget") != 0) {
+    if (strcmp(catalog->products[0].ProductName, "NegTarget") != 0) {
         printf("    Product name should remain unchanged\n");
         return 1;
     }
-    if (products[0].Quantity != 12 || products[0].UnitPrice != 120) {
-        printf("    Negative inputs should not modify values: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != 12 || catalog->products[0].UnitPrice != 120) {
+        printf("    Negative inputs should not modify values: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_sets_zero_values(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_sets_zero_values(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT035");
-    strcpy(products[0].ProductName, "ZeroUpdate");
-    products[0].Quantity = 15;
-    products[0].UnitPrice = 150;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT035");
+    strcpy(catalog->products[0].ProductName, "ZeroUpdate");
+    catalog->products[0].Quantity = 15;
+    catalog->products[0].UnitPrice = 150;
 
-    int rc = update_product("UT035", "ZeroUpdate", 0, 0);
+    int rc = update_product(catalog, "UT035", "ZeroUpdate", 0, 0);
     if (rc != 0) {
         printf("    Expected update_product success when setting zeros, got %d\n", rc);
         return 1;
     }
-    if (products[0].Quantity != 0 || products[0].UnitPrice != 0) {
-        printf("    Zero update did not apply: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != 0 || catalog->products[0].UnitPrice != 0) {
+        printf("    Zero update did not apply: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
-    if (strcmp(products[0].ProductName, "ZeroUpdate") != 0) {
+    if (strcmp(catalog->products[0].ProductName, "ZeroUpdate") != 0) {
         printf("    Product name should remain unchanged\n");
         return 1;
     }
     return 0;
 }
 
-static int test_update_product_preserves_other_records(void) {
-    products = (Product *)malloc(2 * sizeof(Product));
-    if (!products) {
+static int test_update_product_preserves_other_records(Catalog *catalog) {
+    catalog->products = (Product *)malloc(2 * sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 2;
-    product_count = 2;
+    catalog->product_capacity = 2;
+    catalog->product_count = 2;
 
-    strcpy(products[0].ProductID, "UT030");
-    strcpy(products[0].ProductName, "Primary");
-    products[0].Quantity = 11;
-    products[0].UnitPrice = 110;
+    strcpy(catalog->products[0].ProductID, "UT030");
+    strcpy(catalog->products[0].ProductName, "Primary");
+    catalog->products[0].Quantity = 11;
+    catalog->products[0].UnitPrice = 110;
 
-    strcpy(products[1].ProductID, "UT031");
-    strcpy(products[1].ProductName, "Secondary");
-    products[1].Quantity = 22;
-    products[1].UnitPrice = 220;
+    strcpy(catalog->products[1].ProductID, "UT031");
+    strcpy(catalog->products[1].ProductName, "Secondary");
+    catalog->products[1].Quantity = 22;
+    catalog->products[1].UnitPrice = 220;
 
-    int rc = update_product("UT031", "SecondaryUpdated", 33, 330);
+    int rc = update_product(catalog, "UT031", "SecondaryUpdated", 33, 330);
     if (rc != 0) {
         printf("    Expected update_product success, got %d\n", rc);
         return 1;
     }
 
-    if (strcmp(products[0].ProductName, "Primary") != 0 ||
-        products[0].Quantity != 11 ||
-        products[0].UnitPrice != 110) {
+    if (strcmp(catalog->products[0].ProductName, "Primary") != 0 ||
+        catalog->products[0].Quantity != 11 ||
+        catalog->products[0].UnitPrice != 110) {
         printf("    Non-target product mutated\n");
         return 1;
     }
 
-    if (strcmp(products[1].ProductName, "SecondaryUpdated") != 0 ||
-        products[1].Quantity != 33 ||
-        products[1].UnitPrice != 330) {
+    if (strcmp(catalog->products[1].ProductName, "SecondaryUpdated") != 0 ||
+        catalog->products[1].Quantity != 33 ||
+        catalog->products[1].UnitPrice != 330) {
         printf("    Target product not updated correctly\n");
         return 1;
     }
@@ -720,103 +684,2382 @@ static int test_update_product_preserves_other_records(void) {
     return 0;
 }
 
-static int test_update_product_rejects_empty_name(void) {
-    products = (Product *)malloc(sizeof(Product));
-    if (!products) {
+static int test_update_product_rejects_empty_name(Catalog *catalog) {
+    catalog->products = (Product *)malloc(sizeof(Product));
+    if (!catalog->products) {
         printf("    Memory allocation failed\n");
         return 1;
     }
-    product_capacity = 1;
-    product_count = 1;
-    strcpy(products[0].ProductID, "UT032");
-    strcpy(products[0].ProductName, "NonEmpty");
-    products[0].Quantity = 5;
-    products[0].UnitPrice = 50;
+    catalog->product_capacity = 1;
+    catalog->product_count = 1;
+    strcpy(catalog->products[0].ProductID, "UT032");
+    strcpy(catalog->products[0].ProductName, "NonEmpty");
+    catalog->products[0].Quantity = 5;
+    catalog->products[0].UnitPrice = 50;
 
-    int rc = update_product("UT032", "", 8, 80);
+    int rc = update_product(catalog, "UT032", "", 8, 80);
     if (rc != 1) {
         printf("    Expected update_product to reject empty name, got %d\n", rc);
         return 1;
     }
 
-    if (strcmp(products[0].ProductName, "NonEmpty") != 0) {
+    if (strcmp(catalog->products[0].ProductName, "NonEmpty") != 0) {
         printf("    ProductName should remain unchanged after rejection\n");
         return 1;
     }
-    if (products[0].Quantity != 5 || products[0].UnitPrice != 50) {
-        printf("    Quantity/UnitPrice should remain unchanged after rejection: %d/%d\n", products[0].Quantity, products[0].UnitPrice);
+    if (catalog->products[0].Quantity != 5 || catalog->products[0].UnitPrice != 50) {
+        printf("    Quantity/UnitPrice should remain unchanged after rejection: %d/%d\n", catalog->products[0].Quantity, catalog->products[0].UnitPrice);
         return 1;
     }
 
     return 0;
 }
 
-typedef int (*TestFunc)(void);
+// Count data rows in the CSV so persistence checks do not depend on row order.
+static int count_csv_rows(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
 
-typedef struct {
-    const char *name;
-    TestFunc func;
-} TestCase;
+    char line[256];
+    int rows = -1; // header line
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] != '\n' && line[0] != '\r') {
+            rows++;
+        }
+    }
 
-int run_unit_tests(void) {
-    ProductStateBackup state_backup;
-    FileBackup file_backup;
-    if (backup_product_state(&state_backup) != 0) {
-        printf("Failed to back up product state.\n");
+    fclose(fp);
+    return rows;
+}
+
+static int test_transaction_commit_persists_batch(Catalog *catalog) {
+    if (catalog_begin(catalog) != 0) {
+        printf("    catalog_begin failed\n");
+        return 1;
+    }
+    if (add_product(catalog, "TX001", "Batch One", 1, 10) != 0 ||
+        add_product(catalog, "TX002", "Batch Two", 2, 20) != 0 ||
+        update_product(catalog, "TX001", "Batch One Updated", 5, -1) != 0) {
+        printf("    Failed to queue mutations\n");
+        catalog_rollback(catalog);
+        return 1;
+    }
+    if (catalog->product_count != 0) {
+        printf("    Mutations should stay buffered until commit, product_count %d\n", catalog->product_count);
+        catalog_rollback(catalog);
         return 1;
     }
 
-    if (backup_products_file(&file_backup, TEST_PRODUCTS_FILE) != 0) {
-        printf("Failed to back up %s.\n", TEST_PRODUCTS_FILE);
-        restore_product_state(&state_backup);
+    int rc = catalog_commit(catalog);
+    if (rc != 0) {
+        printf("    Expected catalog_commit success, got %d\n", rc);
         return 1;
     }
+    if (catalog->product_count != 2) {
+        printf("    Expected product_count 2 after commit, got %d\n", catalog->product_count);
+        return 1;
+    }
+    if (strcmp(catalog->products[0].ProductName, "Batch One Updated") != 0 ||
+        catalog->products[0].Quantity != 5 ||
+        catalog->products[0].UnitPrice != 10) {
+        printf("    Update inside transaction not applied in order\n");
+        return 1;
+    }
+    int rows = count_csv_rows(TEST_PRODUCTS_FILE);
+    if (rows != 2) {
+        printf("    Expected 2 persisted rows, got %d\n", rows);
+        return 1;
+    }
+    return 0;
+}
 
-    const TestCase tests[] = {
-        {"add_product inserts new entry", test_add_product_inserts_new_entry},
-        {"add_product rejects duplicate IDs", test_add_product_rejects_duplicate_id},
-        {"add_product expands capacity", test_add_product_expands_capacity},
-        {"add_product accepts zero values", test_add_product_accepts_zero_values},
-        {"add_product handles INT_MAX values", test_add_product_handles_large_values},
-        {"add_product rejects empty name", test_add_product_rejects_empty_name},
-        {"add_product rejects whitespace name", test_add_product_rejects_whitespace_name},
-        {"add_product handles max-length strings", test_add_product_handles_max_length_strings},
-        {"add_product persists data to CSV", test_add_product_persists_to_csv},
-        {"add_product appends after manual seed", test_add_product_appends_after_manual_seed},
-        {"update_product changes all fields", test_update_product_changes_fields},
-        {"update_product supports partial updates", test_update_product_handles_partial_updates},
-        {"update_product fails for missing ID", test_update_product_missing_id_fails},
-        {"update_product fails with empty inventory", test_update_product_empty_inventory_fails},
-        {"update_product handles INT_MAX values", test_update_product_handles_max_values},
-        {"update_product ignores negative numbers", test_update_product_rejects_negative_numbers},
-        {"update_product sets zero values", test_update_product_sets_zero_values},
-        {"update_product preserves other records", test_update_product_preserves_other_records},
-        {"update_product rejects empty name", test_update_product_rejects_empty_name}
-    };
+static int test_transaction_rollback_discards_changes(Catalog *catalog) {
+    if (add_product(catalog, "TX010", "Keep", 1, 1) != 0) {
+        printf("    Failed to seed product\n");
+        return 1;
+    }
 
-    const size_t total_tests = sizeof(tests) / sizeof(tests[0]);
-    size_t passed_tests = 0;
+    catalog_begin(catalog);
+    if (remove_product(catalog, "TX010") != 0 || add_product(catalog, "TX011", "Discard", 2, 2) != 0) {
+        printf("    Failed to queue mutations\n");
+        catalog_rollback(catalog);
+        return 1;
+    }
+    if (catalog_rollback(catalog) != 0) {
+        printf("    catalog_rollback failed\n");
+        return 1;
+    }
 
-    printf("Running unit tests...\n\n");
+    if (catalog->product_count != 1 || strcmp(catalog->products[0].ProductID, "TX010") != 0) {
+        printf("    Catalog changed after rollback\n");
+        return 1;
+    }
+    if (catalog_commit(catalog) == 0) {
+        printf("    catalog_commit should fail without an open transaction\n");
+        return 1;
+    }
+    int rows = count_csv_rows(TEST_PRODUCTS_FILE);
+    if (rows != 1) {
+        printf("    Expected 1 persisted row after rollback, got %d\n", rows);
+        return 1;
+    }
+    return 0;
+}
 
-    for (size_t i = 0; i < total_tests; i++) {
-        reset_test_environment();
-        int rc = tests[i].func();
-        if (rc == 0) {
-            printf("\033[1;32m[PASS]\033[0m %s\n", tests[i].name);
-            passed_tests++;
+static int test_transaction_commit_is_atomic(Catalog *catalog) {
+    if (add_product(catalog, "TX020", "Existing", 3, 30) != 0) {
+        printf("    Failed to seed product\n");
+        return 1;
+    }
+
+    catalog_begin(catalog);
+    if (add_product(catalog, "TX021", "Fresh", 4, 40) != 0 ||
+        update_product(catalog, "TX020", "Existing Changed", 9, 90) != 0 ||
+        add_product(catalog, "TX020", "Duplicate", 5, 50) != 0) {
+        printf("    Failed to queue mutations\n");
+        catalog_rollback(catalog);
+        return 1;
+    }
+
+    int rc = catalog_commit(catalog);
+    if (rc != 1) {
+        printf("    Expected catalog_commit to reject duplicate, got %d\n", rc);
+        return 1;
+    }
+    if (catalog->product_count != 1) {
+        printf("    Partial commit leaked rows: product_count %d\n", catalog->product_count);
+        return 1;
+    }
+    if (strcmp(catalog->products[0].ProductName, "Existing") != 0 ||
+        catalog->products[0].Quantity != 3 ||
+        catalog->products[0].UnitPrice != 30) {
+        printf("    Earlier mutation in failed commit was not undone\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_remove_product_persists_to_csv(Catalog *catalog) {
+    if (add_product(catalog, "TX030", "First", 1, 1) != 0 ||
+        add_product(catalog, "TX031", "Second", 2, 2) != 0 ||
+        add_product(catalog, "TX032", "Third", 3, 3) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    int rc = remove_product(catalog, "TX031");
+    if (rc != 0) {
+        printf("    Expected remove_product success, got %d\n", rc);
+        return 1;
+    }
+    if (catalog->product_count != 2 ||
+        strcmp(catalog->products[0].ProductID, "TX030") != 0 ||
+        strcmp(catalog->products[1].ProductID, "TX032") != 0) {
+        printf("    Remaining products incorrect after removal\n");
+        return 1;
+    }
+    int rows = count_csv_rows(TEST_PRODUCTS_FILE);
+    if (rows != 2) {
+        printf("    Expected 2 persisted rows after removal, got %d\n", rows);
+        return 1;
+    }
+    if (remove_product(catalog, "TX031") != 1) {
+        printf("    Removing a missing product should fail\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int write_text_file(const char *path, const char *content) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        return -1;
+    }
+    fputs(content, fp);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+// Two handles share nothing: rows, indexes, files and transactions are per catalog
+static int test_catalogs_are_independent(Catalog *catalog) {
+    Catalog other;
+    catalog_init(&other);
+    if (catalog_configure(&other, TEST_SECOND_FILE, 0) != 0) {
+        catalog_free(&other);
+        printf("    catalog_configure rejected %s\n", TEST_SECOND_FILE);
+        return 1;
+    }
+
+    // A transaction open on one catalog does not hold up writes to the other
+    catalog_begin(catalog);
+    int failed = add_product(catalog, "IND001", "Shared Name", 1, 10) != 0 ||
+                 add_product(&other, "IND001", "Shared Name", 2, 20) != 0 ||
+                 add_product(&other, "IND002", "Other Only", 3, 30) != 0 ||
+                 catalog_commit(catalog) != 0;
+    if (failed) {
+        printf("    Writes to one catalog interfered with the other\n");
+    }
+
+    int *matches = NULL;
+    if (!failed) {
+        failed = find_products_by_keyword(catalog, "ind00", &matches) != 1 ||
+                 catalog->products[matches[0]].Quantity != 1;
+        free(matches);
+        matches = NULL;
+        failed |= find_products_by_query(&other, "id:ind", 3, 1, &matches) != 2 ||
+                  strcmp(other.products[matches[0]].ProductID, "IND002") != 0;
+        free(matches);
+        failed |= count_csv_rows(TEST_PRODUCTS_FILE) != 1 || count_csv_rows(TEST_SECOND_FILE) != 2;
+        if (failed) {
+            printf("    Searches or saves crossed catalogs\n");
+        }
+    }
+
+    catalog_free(&other);
+    remove(TEST_SECOND_FILE);
+    return failed;
+}
+
+// Merged searches interleave the catalogs' matches; edits and reloads stay per catalog
+static int test_search_across_catalogs(Catalog *catalog) {
+    Catalog other;
+    catalog_init(&other);
+    if (catalog_configure(&other, TEST_SECOND_FILE, 0) != 0) {
+        catalog_free(&other);
+        printf("    catalog_configure rejected %s\n", TEST_SECOND_FILE);
+        return 1;
+    }
+    Catalog *catalogs[2] = {catalog, &other};
+
+    int failed = add_product(catalog, "MOU100", "Mouse Pad", 5, 50) != 0 ||
+                 add_product(catalog, "KEY200", "Keyboard", 8, 80) != 0 ||
+                 add_product(&other, "MOUSE", "Wireless Mouse", 3, 30) != 0 ||
+                 add_product(&other, "ZED300", "Mouse Bungee", 9, 90) != 0;
+    if (failed) {
+        printf("    Failed to seed the catalogs\n");
+    }
+
+    // Exact ID first, then the two name-prefix matches in catalog order
+    CatalogRow *rows = NULL;
+    if (!failed) {
+        int count = find_products_across(catalogs, 2, "mouse", SORT_BY_RELEVANCE, 0, &rows);
+        failed = count != 3 ||
+                 rows[0].catalog != 1 || strcmp(other.products[rows[0].row].ProductID, "MOUSE") != 0 ||
+                 rows[1].catalog != 0 || strcmp(catalog->products[rows[1].row].ProductID, "MOU100") != 0 ||
+                 rows[2].catalog != 1 || strcmp(other.products[rows[2].row].ProductID, "ZED300") != 0;
+        free(rows);
+        rows = NULL;
+        if (failed) {
+            printf("    Relevance merge returned %d matches in the wrong order\n", count);
+        }
+    }
+
+    if (!failed) {
+        const int expected_catalogs[4] = {1, 0, 0, 1};
+        const int expected_prices[4] = {90, 80, 50, 30};
+        int count = find_products_across(catalogs, 2, "", SORT_BY_PRICE, 1, &rows);
+        failed = count != 4;
+        for (int i = 0; !failed && i < count; i++) {
+            failed = rows[i].catalog != expected_catalogs[i] ||
+                     catalogs[rows[i].catalog]->products[rows[i].row].UnitPrice != expected_prices[i];
+        }
+        if (failed) {
+            printf("    Price-descending merge interleaved the catalogs wrongly\n");
+        }
+    }
+
+    // Editing a merged row goes to its own catalog and rewrites only that file
+    if (!failed) {
+        Catalog *owner = catalogs[rows[0].catalog];
+        failed = update_product(owner, owner->products[rows[0].row].ProductID, NULL, 12, -1) != 0 ||
+                 count_csv_rows(TEST_PRODUCTS_FILE) != 2 || count_csv_rows(TEST_SECOND_FILE) != 2;
+        if (!failed) {
+            Catalog first;
+            Catalog second;
+            catalog_init(&first);
+            catalog_init(&second);
+            Catalog *reloaded[2] = {&first, &second};
+            failed = catalog_configure(&first, TEST_PRODUCTS_FILE, 0) != 0 ||
+                     catalog_configure(&second, TEST_SECOND_FILE, 0) != 0 ||
+                     load_catalogs(reloaded, 2) != 0 ||
+                     first.product_count != 2 || second.product_count != 2 ||
+                     // Saves write rows in ID order, so compare each file's total
+                     first.products[0].Quantity + first.products[1].Quantity != 5 + 8 ||
+                     second.products[0].Quantity + second.products[1].Quantity != 3 + 12;
+            catalog_free(&first);
+            catalog_free(&second);
+        }
+        if (failed) {
+            printf("    An edit through the merged list reached the wrong file\n");
+        }
+    }
+
+    free(rows);
+    catalog_free(&other);
+    remove(TEST_SECOND_FILE);
+    return failed;
+}
+
+// A command file is one transaction: applied and saved together, or not at all
+static int test_command_file_applies_as_one_batch(Catalog *catalog) {
+    if (add_product(catalog, "CMD001", "Old Name", 1, 10) != 0 ||
+        add_product(catalog, "CMD002", "Doomed", 2, 20) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    write_text_file(TEST_COMMANDS_FILE,
+                    "# nightly stock\n"
+                    "add CMD003,\"Cable, USB\",5,50\n"
+                    "\n"
+                    "update CMD001,New Name,,15\n"
+                    "set-qty CMD003,8\n"
+                    "remove CMD002\n");
+    int failed = exec_command_file(catalog, TEST_COMMANDS_FILE) != 0 ||
+                 catalog->product_count != 2 || count_csv_rows(TEST_PRODUCTS_FILE) != 2 ||
+                 strcmp(catalog->products[0].ProductName, "New Name") != 0 ||
+                 catalog->products[0].Quantity != 1 || catalog->products[0].UnitPrice != 15 ||
+                 strcmp(catalog->products[1].ProductName, "Cable, USB") != 0 ||
+                 catalog->products[1].Quantity != 8;
+    if (failed) {
+        printf("    Commands were not applied as written\n");
+    }
+
+    // The third command names an unknown product, so the first two are undone too
+    if (!failed) {
+        write_text_file(TEST_COMMANDS_FILE,
+                        "set-qty CMD001,99\n"
+                        "add CMD004,Extra,1,1\n"
+                        "remove CMD404\n");
+        failed = exec_command_file(catalog, TEST_COMMANDS_FILE) == 0 || catalog->txn_failed_op != 2 ||
+                 catalog->product_count != 2 || catalog->products[0].Quantity != 1 ||
+                 count_csv_rows(TEST_PRODUCTS_FILE) != 2;
+        if (failed) {
+            printf("    A rejected command left part of its batch applied\n");
+        }
+    }
+
+    if (!failed) {
+        write_text_file(TEST_COMMANDS_FILE, "set-qty CMD001,5\nrestock CMD001,5\n");
+        failed = exec_command_file(catalog, TEST_COMMANDS_FILE) == 0 || catalog->products[0].Quantity != 1;
+        if (failed) {
+            printf("    A command file with a syntax error was applied\n");
+        }
+    }
+
+    remove(TEST_COMMANDS_FILE);
+    return failed;
+}
+
+// Read everything written to fp back into buf
+static void read_back(FILE *fp, char *buf, size_t size) {
+    rewind(fp);
+    size_t length = fread(buf, 1, size - 1, fp);
+    buf[length] = '\0';
+}
+
+static int cold_load_matches_csv(void) {
+    Catalog cold;
+    catalog_init(&cold);
+    int matches = catalog_configure(&cold, TEST_PRODUCTS_FILE, 0) == 0 && load_catalog_cached(&cold) == 0 &&
+                  cold.product_count == 3 && strcmp(cold.products[2].ProductID, "QO003") == 0 &&
+                  strcmp(cold.products[2].ProductName, "Mouse\tPad") == 0;
+    catalog_free(&cold);
+    return matches;
+}
+
+#ifndef _WIN32
+// A snapshot that matches the CSV but was cut short, or whose last name lost its
+// terminator, is rejected in favour of the CSV
+static int check_corrupt_snapshots(const char *snapshot) {
+    // Snapshots are only written for a CSV already older than them
+    time_t past = time(NULL) - 10;
+    struct utimbuf times = {past, past};
+    remove(snapshot);
+    if (utime(TEST_PRODUCTS_FILE, &times) != 0 || !cold_load_matches_csv()) {
+        printf("    Could not take a snapshot\n");
+        return 1;
+    }
+    unsigned char data[1024];
+    FILE *fp = fopen(snapshot, "rb");
+    size_t size = fp ? fread(data, 1, sizeof(data), fp) : 0;
+    if (fp) {
+        fclose(fp);
+    }
+    if (size < 3 * sizeof(Product) || size == sizeof(data)) {
+        printf("    No snapshot was written\n");
+        return 1;
+    }
+
+    unsigned char corrupt[1024];
+    for (int variant = 0; variant < 2; variant++) {
+        size_t kept = size;
+        memcpy(corrupt, data, size);
+        if (variant == 0) {
+            kept = size - sizeof(Product) / 2;
         } else {
-            printf("\033[31m[FAIL]\033[0m %s\n", tests[i].name);
+            memset(corrupt + size - sizeof(Product) + offsetof(Product, ProductName), 'x', sizeof(((Product *)0)->ProductName));
+        }
+        fp = fopen(snapshot, "wb");
+        if (!fp || fwrite(corrupt, 1, kept, fp) != kept) {
+            if (fp) {
+                fclose(fp);
+            }
+            printf("    Could not rewrite the snapshot\n");
+            return 1;
+        }
+        fclose(fp);
+        if (!cold_load_matches_csv()) {
+            printf("    A cold load trusted a %s snapshot\n", variant == 0 ? "truncated" : "unterminated");
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+// --query output in each format, and cold loads that distrust a snapshot not matching the CSV
+static int test_query_output_formats(Catalog *catalog) {
+    if (add_product(catalog, "QO001", "Mouse, \"Pro\"", 3, 30) != 0 ||
+        add_product(catalog, "QO002", "Keyboard", 4, 40) != 0 ||
+        add_product(catalog, "QO003", "Mouse\tPad", 5, 50) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    const OutputFormat formats[3] = {OUTPUT_FORMAT_CSV, OUTPUT_FORMAT_TSV, OUTPUT_FORMAT_JSON};
+    const char *expected[3] = {
+        "ProductID,ProductName,Quantity,UnitPrice\n"
+        "QO001,\"Mouse, \"\"Pro\"\"\",3,30\n"
+        "QO003,Mouse\tPad,5,50\n",
+        "ProductID\tProductName\tQuantity\tUnitPrice\n"
+        "QO001\tMouse, \"Pro\"\t3\t30\n"
+        "QO003\tMouse Pad\t5\t50\n",
+        "[\n"
+        "{\"ProductID\":\"QO001\",\"ProductName\":\"Mouse, \\\"Pro\\\"\",\"Quantity\":3,\"UnitPrice\":30},\n"
+        "{\"ProductID\":\"QO003\",\"ProductName\":\"Mouse\\u0009Pad\",\"Quantity\":5,\"UnitPrice\":50}\n"
+        "]\n"
+    };
+    char output[1024];
+    int failed = 0;
+    for (int i = 0; !failed && i < 3; i++) {
+        FILE *fp = tmpfile();
+        if (!fp) {
+            printf("    tmpfile failed\n");
+            return 1;
+        }
+        failed = write_query_results(&catalog, 1, "mouse", formats[i], fp) != 2;
+        read_back(fp, output, sizeof(output));
+        fclose(fp);
+        if (failed || strcmp(output, expected[i]) != 0) {
+            printf("    Format %d wrote:\n%s", i, output);
+            failed = 1;
         }
     }
 
-    reset_test_environment();
+    // A snapshot that does not describe the CSV is ignored and the CSV is parsed instead
+    char snapshot[600];
+    snprintf(snapshot, sizeof(snapshot), "%s.snap", TEST_PRODUCTS_FILE);
+    if (!failed) {
+        write_text_file(snapshot, "POMSNAP1 not really a snapshot");
+        failed = !cold_load_matches_csv();
+        if (failed) {
+            printf("    A cold load trusted a stale snapshot\n");
+        }
+    }
+#ifndef _WIN32
+    if (!failed) {
+        failed = check_corrupt_snapshots(snapshot);
+    }
+#endif
+    remove(snapshot);
+    return failed;
+}
 
-    if (restore_products_file(&file_backup, TEST_PRODUCTS_FILE) != 0) {
-        printf("Warning: Failed to restore %s.\n", TEST_PRODUCTS_FILE);
+static int test_reload_applies_keyed_diff(Catalog *catalog) {
+    if (add_product(catalog, "RL001", "Stays", 1, 10) != 0 ||
+        add_product(catalog, "RL002", "Changes", 2, 20) != 0 ||
+        add_product(catalog, "RL003", "Goes", 3, 30) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
     }
 
-    restore_product_state(&state_backup);
+    if (write_text_file(TEST_PRODUCTS_FILE,
+                        "ProductID,ProductName,Quantity,UnitPrice\n"
+                        "RL004,Arrives,4,40\n"
+                        "RL002,Changed,22,20\n"
+                        "RL001,Stays,1,10\n") != 0) {
+        printf("    Failed to rewrite %s\n", TEST_PRODUCTS_FILE);
+        return 1;
+    }
+
+    int added = -1;
+    int updated = -1;
+    int removed = -1;
+    int rc = reload_csv_incremental(catalog, TEST_PRODUCTS_FILE, &added, &updated, &removed);
+    if (rc != 0) {
+        printf("    Expected reload success, got %d\n", rc);
+        return 1;
+    }
+    if (added != 1 || updated != 1 || removed != 1) {
+        printf("    Unexpected diff: +%d ~%d -%d\n", added, updated, removed);
+        return 1;
+    }
+    if (catalog->product_count != 3 ||
+        strcmp(catalog->products[0].ProductID, "RL001") != 0 ||
+        strcmp(catalog->products[1].ProductID, "RL002") != 0 ||
+        strcmp(catalog->products[2].ProductID, "RL004") != 0) {
+        printf("    Rows not kept in place / appended after reload\n");
+        return 1;
+    }
+    if (strcmp(catalog->products[1].ProductName, "Changed") != 0 || catalog->products[1].Quantity != 22) {
+        printf("    Changed row not applied\n");
+        return 1;
+    }
+
+    rc = reload_csv_incremental(catalog, TEST_PRODUCTS_FILE, &added, &updated, &removed);
+    if (rc != 0 || added != 0 || updated != 0 || removed != 0) {
+        printf("    Reloading an unchanged file should be a no-op\n");
+        return 1;
+    }
+    return 0;
+}
+
+// A small outside edit is applied through the maintained indexes instead of dropping them
+static int test_reload_keeps_indexes_for_small_diff(Catalog *catalog) {
+    char id[16];
+    char name[32];
+    for (int i = 0; i < 10; i++) {
+        snprintf(id, sizeof(id), "RK%03d", i);
+        snprintf(name, sizeof(name), "Item %d", i);
+        if (add_product(catalog, id, name, i, 100 - i) != 0) {
+            printf("    Failed to seed products\n");
+            return 1;
+        }
+    }
+    int *matches = NULL;
+    if (find_products_by_query(catalog, "id:rk", SORT_BY_PRICE, 0, &matches) != 10 || !catalog->sort_indexes_ready) {
+        free(matches);
+        printf("    Sort indexes were not built\n");
+        return 1;
+    }
+    free(matches);
+    matches = NULL;
+
+    // RK003 gets the highest price, RK005 goes, RK010 arrives with the lowest
+    FILE *fp = fopen(TEST_PRODUCTS_FILE, "w");
+    if (!fp) {
+        return 1;
+    }
+    fprintf(fp, "ProductID,ProductName,Quantity,UnitPrice\n");
+    for (int i = 0; i < 10; i++) {
+        if (i != 5) {
+            fprintf(fp, "RK%03d,Item %d,%d,%d\n", i, i, i, i == 3 ? 500 : 100 - i);
+        }
+    }
+    fprintf(fp, "RK010,Item 10,10,1\n");
+    fclose(fp);
+
+    int added = -1;
+    int updated = -1;
+    int removed = -1;
+    int failed = reload_csv_incremental(catalog, TEST_PRODUCTS_FILE, &added, &updated, &removed) != 0 ||
+                 added != 1 || updated != 1 || removed != 1;
+    if (failed) {
+        printf("    Unexpected diff: +%d ~%d -%d\n", added, updated, removed);
+        return 1;
+    }
+    if (!catalog->sort_indexes_ready || !catalog->id_index_ready) {
+        printf("    Reload dropped the indexes for a three-row change\n");
+        return 1;
+    }
+
+    const char *expected[10] = {"RK010", "RK009", "RK008", "RK007", "RK006", "RK004", "RK002", "RK001", "RK000", "RK003"};
+    int count = find_products_by_query(catalog, "", SORT_BY_PRICE, 0, &matches);
+    failed = count != 10;
+    for (int i = 0; !failed && i < count; i++) {
+        failed = strcmp(catalog->products[matches[i]].ProductID, expected[i]) != 0;
+    }
+    free(matches);
+    matches = NULL;
+    failed |= find_products_by_query(catalog, "id=RK005", SORT_BY_ROW, 0, &matches) != 0;
+    free(matches);
+    matches = NULL;
+    failed |= find_products_by_query(catalog, "id=RK010", SORT_BY_ROW, 0, &matches) != 1;
+    free(matches);
+    if (failed) {
+        printf("    Indexes kept across the reload disagree with the rows\n");
+    }
+    return failed;
+}
+
+#define TEST_WATCH_SAVES 50
+
+static void *save_catalog_repeatedly(void *arg) {
+    for (int i = 0; i < TEST_WATCH_SAVES; i++) {
+        save_csv((Catalog *)arg, TEST_PRODUCTS_FILE);
+    }
+    return NULL;
+}
+
+static int test_file_watch_detects_external_write(Catalog *catalog) {
+    if (write_text_file(TEST_PRODUCTS_FILE, "ProductID,ProductName,Quantity,UnitPrice\n") != 0) {
+        printf("    Failed to create %s\n", TEST_PRODUCTS_FILE);
+        return 1;
+    }
+
+    FileWatch watch;
+    if (file_watch_open(&watch, TEST_PRODUCTS_FILE) != 0) {
+        printf("    file_watch_open failed\n");
+        return 1;
+    }
+
+    int result = 0;
+    if (file_watch_poll(&watch) != 0) {
+        printf("    Fresh watch reported a change\n");
+        result = 1;
+    }
+
+    // Grow the file so the stat fallback sees a new size even within the same second
+    if (result == 0 && write_text_file(TEST_PRODUCTS_FILE,
+                                       "ProductID,ProductName,Quantity,UnitPrice\n"
+                                       "FW001,Watched,1,1\n") != 0) {
+        printf("    Failed to modify %s\n", TEST_PRODUCTS_FILE);
+        result = 1;
+    }
+    if (result == 0 && file_watch_poll(&watch) != 1) {
+        printf("    External write was not detected\n");
+        result = 1;
+    }
+    if (result == 0 && file_watch_poll(&watch) != 0) {
+        printf("    Change was reported twice\n");
+        result = 1;
+    }
+
+    // Saves share the catalog lock and sync the watch while the menu thread polls it
+    if (result == 0 && add_product(catalog, "FW002", "Saved", 1, 1) == 0) {
+        catalog->watch = &watch;
+        pthread_t savers[2];
+        int started = 0;
+        while (started < 2 && pthread_create(&savers[started], NULL, save_catalog_repeatedly, catalog) == 0) {
+            started++;
+        }
+        for (int i = 0; i < TEST_WATCH_SAVES; i++) {
+            file_watch_poll(&watch);
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(savers[i], NULL);
+        }
+        save_csv(catalog, TEST_PRODUCTS_FILE);
+        catalog->watch = NULL;
+        if (file_watch_poll(&watch) != 0) {
+            printf("    Our own saves were reported as a change\n");
+            result = 1;
+        }
+    }
+
+    file_watch_close(&watch);
+    return result;
+}
+
+static void count_event(void *ctx) {
+    (*(int *)ctx)++;
+}
+
+static void redraw_event(void *ctx) {
+    (*(int *)ctx)++;
+    event_loop_request_redraw();
+}
+
+static int test_event_loop_dispatches_events(Catalog *catalog) {
+    (void)catalog;
+    int result = 0;
+    int fired = 0;
+    // Redraws a menu watch requested before the tests started would end the waits early
+    while (event_loop_wait_input(-1, 0) == EVENT_LOOP_REDRAW) {
+        continue;
+    }
+    int timer = event_loop_add_timer(5, 0, count_event, &fired);
+    if (timer <= 0) {
+        printf("    Timer was not accepted\n");
+        return 1;
+    }
+    if (event_loop_wait_input(-1, 200) != EVENT_LOOP_TIMEOUT || fired != 1) {
+        printf("    One-shot timer fired %d times\n", fired);
+        result = 1;
+    }
+    event_loop_cancel_timer(timer); // fired points into this frame; never let it outlive the test
+
+    int posted = 0;
+    if (result == 0 && (event_loop_post(redraw_event, &posted) != 0 ||
+                        event_loop_wait_input(-1, 1000) != EVENT_LOOP_REDRAW || posted != 1)) {
+        printf("    Posted callback did not request a redraw\n");
+        result = 1;
+    }
+
+    int worked = 0;
+    int ticks = 0;
+    if (result == 0 && (event_loop_run_task(count_event, &worked, count_event, &ticks, 1) != 0 || worked != 1)) {
+        printf("    Background task did not run\n");
+        result = 1;
+    }
+
+#ifndef _WIN32
+    int fds[2];
+    if (result == 0 && pipe(fds) == 0) {
+        if (event_loop_wait_input(fds[0], 0) != EVENT_LOOP_TIMEOUT) {
+            printf("    Empty pipe reported as readable\n");
+            result = 1;
+        }
+        if (result == 0 && (write(fds[1], "k", 1) != 1 || event_loop_wait_input(fds[0], 1000) != EVENT_LOOP_READY)) {
+            printf("    Written pipe was not reported as readable\n");
+            result = 1;
+        }
+        event_loop_wait_input(-1, 0); // drop the pipe from the loop before closing it
+        close(fds[0]);
+        close(fds[1]);
+    }
+#endif
+
+    // Run anything still queued while posted still points into this frame
+    event_loop_wait_input(-1, 0);
+    return result;
+}
+
+// Frame output taken from the write_output hook instead of the terminal
+static char g_captured_output[8192];
+static size_t g_captured_len = 0;
+
+static long capture_output(const char *data, size_t len) {
+    size_t room = sizeof(g_captured_output) - 1 - g_captured_len;
+    size_t kept = len < room ? len : room;
+    memcpy(g_captured_output + g_captured_len, data, kept);
+    g_captured_len += kept;
+    g_captured_output[g_captured_len] = '\0';
+    return (long)len;
+}
+
+// Ten list rows starting at item first, marked as a scroll region; row edited_row
+// (or none, -1) reads differently
+static void draw_test_frame(int first, int edited_row) {
+    g_captured_len = 0;
+    g_captured_output[0] = '\0';
+    screen_begin_frame();
+    screen_printf("Header\n\n");
+    for (int i = 0; i < 10; i++) {
+        screen_printf(i == edited_row ? "Item %d edited %s\n" : "Item %d %s\n", first + i,
+                      "........................................");
+    }
+    screen_mark_scroll_region(2, 11);
+    screen_printf("Footer\n");
+    screen_end_frame();
+}
+
+static int test_screen_writes_only_changed_lines(Catalog *catalog) {
+    (void)catalog;
+    HelpersHooks hooks = {NULL, NULL, NULL, NULL, capture_output, NULL};
+    helpers_set_hooks(&hooks);
+    screen_invalidate();
+
+    int result = 0;
+    ScreenStats stats;
+    draw_test_frame(0, -1);
+    screen_reset_stats();
+    draw_test_frame(0, -1);
+    screen_get_stats(&stats);
+    if (stats.frames != 1 || stats.last_syscalls != 0 || stats.last_bytes != 0) {
+        printf("    Unchanged frame wrote %lu bytes in %lu calls\n", stats.last_bytes, stats.last_syscalls);
+        result = 1;
+    }
+
+    draw_test_frame(0, 4);
+    screen_get_stats(&stats);
+    if (result == 0 && (stats.last_syscalls != 1 || stats.last_bytes > 80 ||
+                        !strstr(g_captured_output, "Item 4 edited") || strstr(g_captured_output, "Item 3"))) {
+        printf("    One changed line wrote %lu bytes in %lu calls\n", stats.last_bytes, stats.last_syscalls);
+        result = 1;
+    }
+    if (result == 0 && (stats.frames != 2 || stats.syscalls != 1 || stats.bytes != stats.last_bytes)) {
+        printf("    Frame counters do not add up\n");
+        result = 1;
+    }
+
+    helpers_set_hooks(NULL);
+    screen_invalidate();
+    return result;
+}
+
+static int test_screen_scrolls_list_by_one_row(Catalog *catalog) {
+    (void)catalog;
+    HelpersHooks hooks = {NULL, NULL, NULL, NULL, capture_output, NULL};
+    helpers_set_hooks(&hooks);
+    screen_invalidate();
+
+    int result = 0;
+    ScreenStats stats;
+    screen_reset_stats();
+    draw_test_frame(0, -1);
+    screen_get_stats(&stats);
+    unsigned long full_bytes = stats.last_bytes;
+
+    draw_test_frame(1, -1);
+    screen_get_stats(&stats);
+    if (!strstr(g_captured_output, "\033[3;12r") || !strstr(g_captured_output, "Item 10") ||
+        strstr(g_captured_output, "Item 5")) {
+        printf("    Paging down one row did not scroll the region\n");
+        result = 1;
+    }
+    if (result == 0 && (stats.last_syscalls != 1 || stats.last_bytes * 3 > full_bytes)) {
+        printf("    Scrolling wrote %lu bytes in %lu calls, a full frame is %lu bytes\n",
+               stats.last_bytes, stats.last_syscalls, full_bytes);
+        result = 1;
+    }
+
+    draw_test_frame(0, -1);
+    if (result == 0 && (!strstr(g_captured_output, "\033M") || !strstr(g_captured_output, "Item 0") ||
+                        strstr(g_captured_output, "Item 5"))) {
+        printf("    Paging up one row did not scroll the region back\n");
+        result = 1;
+    }
+
+    helpers_set_hooks(NULL);
+    screen_invalidate();
+    return result;
+}
+
+// Raw input handed out one chunk per read, as the terminal would deliver it
+static const char *const *g_input_chunks = NULL;
+static size_t g_input_chunk_count = 0;
+static size_t g_input_chunk_index = 0;
+
+static long scripted_read_input(unsigned char *buffer, size_t size, int timeout_ms) {
+    (void)timeout_ms;
+    if (g_input_chunk_index >= g_input_chunk_count) {
+        return 0;
+    }
+    const char *chunk = g_input_chunks[g_input_chunk_index++];
+    size_t len = strlen(chunk);
+    if (len > size) {
+        len = size;
+    }
+    memcpy(buffer, chunk, len);
+    return (long)len;
+}
+
+static void script_input(const char *const *chunks, size_t count) {
+    g_input_chunks = chunks;
+    g_input_chunk_count = count;
+    g_input_chunk_index = 0;
+}
+
+static int test_read_menu_key_decodes_sequences(Catalog *catalog) {
+    (void)catalog;
+    int result = 0;
+#ifndef _WIN32
+    // Every sequence in one read (the menu has no use for Home, End or Delete, which are
+    // consumed whole), an ESC split from the rest of its sequence, an ESC followed by an
+    // ordinary key, and a lone ESC with nothing behind it
+    static const char *const chunks[] = {
+        "\033[A\033[B\033[H\033[F\033[1~\033[4~\033OH\033[5~\033[6~\033[1;5A\033[3~q",
+        "\033",
+        "[B",
+        "\033x",
+        "\033"
+    };
+    static const MenuKey expected[] = {
+        MENU_KEY_UP, MENU_KEY_DOWN, MENU_KEY_NONE, MENU_KEY_NONE, MENU_KEY_NONE, MENU_KEY_NONE,
+        MENU_KEY_NONE, MENU_KEY_NONE, MENU_KEY_NONE, MENU_KEY_UP, MENU_KEY_NONE, MENU_KEY_CHAR,
+        MENU_KEY_DOWN,
+        MENU_KEY_ESCAPE, MENU_KEY_CHAR,
+        MENU_KEY_ESCAPE,
+        MENU_KEY_NONE
+    };
+    HelpersHooks hooks = {NULL, NULL, NULL, NULL, NULL, scripted_read_input};
+    helpers_set_hooks(&hooks);
+    script_input(chunks, sizeof(chunks) / sizeof(chunks[0]));
+
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        int digit = -1;
+        char typed = '\0';
+        MenuKey key = read_menu_key(&digit, &typed);
+        if (key != expected[i]) {
+            printf("    Key %zu decoded as %d, expected %d\n", i, (int)key, (int)expected[i]);
+            result = 1;
+            break;
+        }
+        if (key == MENU_KEY_CHAR && typed != (i == 11 ? 'q' : 'x')) {
+            printf("    Key %zu typed '%c'\n", i, typed);
+            result = 1;
+            break;
+        }
+    }
+
+    script_input(NULL, 0);
+    helpers_set_hooks(NULL);
+#endif
+    return result;
+}
+
+// Typed keys already queued are applied as one batch: a pasted filter is one search and one frame
+static int test_pasted_filter_runs_one_search(Catalog *catalog) {
+    int result = 0;
+#ifndef _WIN32
+    add_product(catalog, "PST001", "Paste Mouse", 5, 100);
+    add_product(catalog, "PST002", "Paste Keyboard", 5, 200);
+
+    static const char *const chunks[] = {"mouse", "\021"}; // the paste, then Ctrl+Q on its own
+    HelpersHooks hooks = {NULL, NULL, NULL, NULL, capture_output, scripted_read_input};
+    helpers_set_hooks(&hooks);
+    script_input(chunks, sizeof(chunks) / sizeof(chunks[0]));
+    screen_invalidate();
+    screen_reset_stats();
+    g_captured_len = 0;
+
+    Catalog *catalogs[1] = {catalog};
+    menu_product_manager(catalogs, 1);
+
+    ScreenStats stats;
+    screen_get_stats(&stats);
+    // Every pass of the menu loop searches at most once before it draws its frame
+    if (stats.frames != 2) {
+        printf("    Pasting five characters drew %lu frames, expected 2\n", stats.frames);
+        result = 1;
+    }
+    if (result == 0 && (!strstr(g_captured_output, "Filter: \033[1;32mmouse") ||
+                        !strstr(g_captured_output, "Matches: 1 "))) {
+        printf("    The pasted filter was not searched as one query\n");
+        result = 1;
+    }
+
+    script_input(NULL, 0);
+    helpers_set_hooks(NULL);
+    screen_invalidate();
+#else
+    (void)catalog;
+#endif
+    return result;
+}
+
+static int ostree_test_compare(int a, int b, void *ctx) {
+    const int *keys = (const int *)ctx;
+    return (keys[a] > keys[b]) - (keys[a] < keys[b]);
+}
+
+static int ostree_test_keys_in_order(const int *keys, int count, const OSTree *tree) {
+    int previous = -1;
+    for (int rank = 0; rank < count; rank++) {
+        int item = ostree_select(tree, rank);
+        if (item < 0 || ostree_rank(tree, item) != rank) {
+            return 0;
+        }
+        if (previous >= 0 && (keys[previous] > keys[item] || (keys[previous] == keys[item] && previous > item))) {
+            return 0;
+        }
+        previous = item;
+    }
+    return ostree_size(tree) == count;
+}
+
+static int test_ostree_tracks_order_and_ranks(Catalog *catalog) {
+    (void)catalog;
+    enum { MAX_ITEMS = 600 };
+    int keys[MAX_ITEMS];
+    int count = 0;
+    OSTree tree;
+    ostree_init(&tree, ostree_test_compare, keys);
+
+    int result = 0;
+    unsigned seed = 12345u;
+    for (int step = 0; step < 2000 && result == 0; step++) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned choice = (seed >> 16) % 4;
+        int key = (int)((seed >> 8) % 97);
+        if (choice <= 1 && count < MAX_ITEMS) {
+            keys[count] = key; // append
+            ostree_insert(&tree, count);
+            count++;
+        } else if (choice == 2 && count > 0) {
+            int item = (int)(seed % (unsigned)count); // re-key in place
+            ostree_erase(&tree, item);
+            keys[item] = key;
+            ostree_insert(&tree, item);
+        } else if (count > 0) {
+            int item = (int)(seed % (unsigned)count); // remove from the middle, closing the gap
+            ostree_erase(&tree, item);
+            memmove(&keys[item], &keys[item + 1], (size_t)(count - item - 1) * sizeof(int));
+            count--;
+            ostree_remove_slot(&tree, item);
+            if (count > 0 && step % 5 == 0) {
+                // ...and put one back at the same place
+                memmove(&keys[item + 1], &keys[item], (size_t)(count - item) * sizeof(int));
+                keys[item] = key;
+                ostree_insert_slot(&tree, item);
+                ostree_insert(&tree, item);
+                count++;
+            }
+        }
+        if (!ostree_test_keys_in_order(keys, count, &tree)) {
+            printf("    Order broken after step %d\n", step);
+            result = 1;
+        }
+    }
+
+    if (result == 0 && count > 10) {
+        OSTreeIter iter;
+        memset(&iter, 0, sizeof(iter));
+        int start = count / 3;
+        if (ostree_iter_seek(&iter, &tree, start, 1) != 0) {
+            printf("    Reverse seek failed\n");
+            result = 1;
+        }
+        for (int rank = count - 1 - start; result == 0 && rank >= 0; rank--) {
+            if (ostree_iter_next(&iter) != ostree_select(&tree, rank)) {
+                printf("    Reverse walk diverged at rank %d\n", rank);
+                result = 1;
+            }
+        }
+        if (result == 0 && ostree_iter_next(&iter) != -1) {
+            printf("    Reverse walk did not stop\n");
+            result = 1;
+        }
+        ostree_iter_free(&iter);
+    }
+
+    ostree_free(&tree);
+    return result;
+}
+
+static int expect_sorted_ids(Catalog *catalog, int sort_key, int descending, const char *const *ids, int count) {
+    for (int rank = 0; rank < count; rank++) {
+        int row = catalog_sorted_row(catalog, sort_key, descending, rank);
+        if (row < 0 || strcmp(catalog->products[row].ProductID, ids[rank]) != 0) {
+            printf("    Rank %d of sort %d%s is %s, expected %s\n", rank, sort_key, descending ? " desc" : "",
+                   row < 0 ? "<none>" : catalog->products[row].ProductID, ids[rank]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_sorted_view_follows_mutations(Catalog *catalog) {
+    reset_test_environment(catalog);
+    const int sort_by_name = 2;
+    const int sort_by_quantity = 3;
+
+    if (add_product(catalog, "S003", "cherry", 30, 3) != 0 || add_product(catalog, "S001", "Apple", 10, 1) != 0 ||
+        add_product(catalog, "S002", "banana", 20, 2) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    const char *by_name[] = {"S001", "S002", "S003"};
+    if (expect_sorted_ids(catalog, sort_by_name, 0, by_name, 3) != 0) {
+        return 1;
+    }
+
+    // Indexes are now built, so these changes go through incremental maintenance
+    if (update_product(catalog, "S003", NULL, 5, -1) != 0 || remove_product(catalog, "S001") != 0 ||
+        add_product(catalog, "S004", "apricot", 25, 4) != 0) {
+        printf("    Failed to mutate products\n");
+        return 1;
+    }
+
+    const char *by_quantity_desc[] = {"S004", "S002", "S003"};
+    const char *by_name_after[] = {"S004", "S002", "S003"};
+    if (expect_sorted_ids(catalog, sort_by_quantity, 1, by_quantity_desc, 3) != 0 ||
+        expect_sorted_ids(catalog, sort_by_name, 0, by_name_after, 3) != 0) {
+        return 1;
+    }
+
+    // A failed commit undoes its ops; the indexes must follow the undo
+    catalog_begin(catalog);
+    remove_product(catalog, "S002");
+    add_product(catalog, "S004", "duplicate", 1, 1);
+    catalog_commit(catalog);
+    if (expect_sorted_ids(catalog, sort_by_quantity, 1, by_quantity_desc, 3) != 0) {
+        return 1;
+    }
+    if (catalog_sorted_row(catalog, sort_by_quantity, 0, 3) != -1) {
+        printf("    Rank past the end returned a row\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int expect_ranked_ids(Catalog *catalog, const char *keyword, int offset, const char *const *expected, int count) {
+    int rows[8];
+    int produced = find_products_ranked(catalog, keyword, offset, count, rows);
+    if (produced != count) {
+        printf("    Ranked search for \"%s\" returned %d rows, expected %d\n", keyword, produced, count);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(catalog->products[rows[i]].ProductID, expected[i]) != 0) {
+            printf("    Rank %d for \"%s\" was %s, expected %s\n", offset + i, keyword, catalog->products[rows[i]].ProductID, expected[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_ranked_search_orders_by_match_quality(Catalog *catalog) {
+    reset_test_environment(catalog);
+
+    // Seeded worst match first so array order alone would get everything wrong
+    if (add_product(catalog, "Q1", "Slab1 offcut", 1, 1) != 0 || add_product(catalog, "XAB12", "Cable", 1, 1) != 0 ||
+        add_product(catalog, "Z9", "The ab1 kit", 1, 1) != 0 || add_product(catalog, "AB10", "Other", 1, 1) != 0 ||
+        add_product(catalog, "AB1", "Widget", 1, 1) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    const char *best_first[] = {"AB1", "AB10", "Z9", "Q1", "XAB12"};
+    const char *tail[] = {"Q1", "XAB12"};
+    if (expect_ranked_ids(catalog, "ab1", 0, best_first, 5) != 0 || expect_ranked_ids(catalog, "AB1", 3, tail, 2) != 0) {
+        return 1;
+    }
+
+    // More matches than are selected up front: paging deep must extend the selection
+    for (int i = 0; i < 300; i++) {
+        char id[20];
+        char name[100];
+        snprintf(id, sizeof(id), "R%03d", i);
+        snprintf(name, sizeof(name), "Bulk item %d", i);
+        if (add_product(catalog, id, name, 1, 1) != 0) {
+            printf("    Failed to seed bulk products\n");
+            return 1;
+        }
+    }
+    add_product(catalog, "ITEM", "Exact", 1, 1);
+    const char *first[] = {"ITEM", "R000"};
+    const char *deep[] = {"R250", "R251"};
+    if (expect_ranked_ids(catalog, "item", 0, first, 2) != 0 || expect_ranked_ids(catalog, "item", 251, deep, 2) != 0) {
+        return 1;
+    }
+    int rows[4];
+    if (find_products_ranked(catalog, "item", 301, 4, rows) != 0 || find_products_ranked(catalog, "zzz", 0, 4, rows) != 0) {
+        printf("    Ranked search past the last match returned rows\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_query_parser_reads_field_tests(Catalog *catalog) {
+    (void)catalog;
+    Query query;
+    int count = query_parse("name:Mouse qty<5 price>=1000 \"USB cable\" id= bogus:1 qty<abc id=B7", &query);
+    if (count != 7) {
+        printf("    Parsed %d terms, expected 7\n", count);
+        return 1;
+    }
+    const QueryTerm *t = query.terms;
+    if (t[0].field != QUERY_NAME || strcmp(t[0].text, "mouse") != 0 ||
+        t[1].field != QUERY_QUANTITY || t[1].low != INT_MIN || t[1].high != 4 ||
+        t[2].field != QUERY_PRICE || t[2].low != 1000 || t[2].high != INT_MAX ||
+        t[3].field != QUERY_TEXT || strcmp(t[3].text, "usb cable") != 0 ||
+        t[4].field != QUERY_TEXT || strcmp(t[4].text, "bogus:1") != 0 ||
+        t[5].field != QUERY_TEXT || strcmp(t[5].text, "qty<abc") != 0 ||
+        t[6].field != QUERY_ID_EXACT || strcmp(t[6].text, "b7") != 0) {
+        printf("    Terms were not parsed as expected\n");
+        return 1;
+    }
+    if (query_parse("qty>2147483647", &query) != 1 || query.terms[0].low <= query.terms[0].high) {
+        printf("    Out-of-range comparison did not give an empty range\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int expect_query_ids(Catalog *catalog, const char *query, int sort_key, int descending, const char *first, const char *last, int count) {
+    int *matches = NULL;
+    int found = find_products_by_query(catalog, query, sort_key, descending, &matches);
+    int ok = found == count;
+    if (ok && count > 0) {
+        ok = strcmp(catalog->products[matches[0]].ProductID, first) == 0 &&
+             strcmp(catalog->products[matches[count - 1]].ProductID, last) == 0;
+    }
+    if (!ok) {
+        printf("    Query \"%s\" (order %d%s) returned %d rows starting %s, expected %d from %s to %s\n",
+               query, sort_key, descending ? " desc" : "", found,
+               found > 0 ? catalog->products[matches[0]].ProductID : "-", count, first ? first : "-", last ? last : "-");
+    }
+    free(matches);
+    return ok ? 0 : 1;
+}
+
+static int test_query_filter_plans(Catalog *catalog) {
+    reset_test_environment(catalog);
+    const int sort_by_row = 0;
+    const int sort_by_id = 1;
+    const int sort_by_quantity = 3;
+
+    // Inserted in descending ID order so row order and ID order differ
+    catalog_begin(catalog);
+    for (int i = 39; i >= 0; i--) {
+        char id[20];
+        char name[100];
+        snprintf(id, sizeof(id), "Q%02d", i);
+        snprintf(name, sizeof(name), "%s %d", i % 2 == 0 ? "Mouse" : "Keyboard", i);
+        add_product(catalog, id, name, i, i * 10);
+    }
+    if (catalog_commit(catalog) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    // Narrow ranges drive the walk (directly in their own order, re-sorted otherwise); wide
+    // ones on another column stay residual checks of a full scan
+    if (expect_query_ids(catalog, "qty<3", sort_by_row, 0, "Q02", "Q00", 3) != 0 ||
+        expect_query_ids(catalog, "qty<3", sort_by_quantity, 1, "Q02", "Q00", 3) != 0 ||
+        expect_query_ids(catalog, "qty>=37", sort_by_id, 0, "Q37", "Q39", 3) != 0 ||
+        expect_query_ids(catalog, "qty>=10 name:mouse", sort_by_row, 0, "Q38", "Q10", 15) != 0 ||
+        expect_query_ids(catalog, "price>=100 mouse price<=150", sort_by_quantity, 0, "Q10", "Q14", 3) != 0 ||
+        expect_query_ids(catalog, "id:q1", sort_by_id, 1, "Q19", "Q10", 10) != 0 ||
+        expect_query_ids(catalog, "id=q07 keyboard", sort_by_row, 0, "Q07", "Q07", 1) != 0 ||
+        expect_query_ids(catalog, "qty<0", sort_by_row, 0, NULL, NULL, 0) != 0 ||
+        expect_query_ids(catalog, "", sort_by_quantity, 1, "Q39", "Q00", 40) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+static int expect_range_ids(Catalog *catalog, int sort_key, int low, int high, const char *const *expected, int count) {
+    int *matches = NULL;
+    int found = find_products_in_range(catalog, sort_key, low, high, &matches);
+    int ok = found == count;
+    for (int i = 0; ok && i < count; i++) {
+        ok = strcmp(catalog->products[matches[i]].ProductID, expected[i]) == 0;
+    }
+    if (!ok) {
+        printf("    Range [%d, %d] of column %d returned %d rows, expected %d\n", low, high, sort_key, found, count);
+    }
+    free(matches);
+    return ok ? 0 : 1;
+}
+
+static int test_numeric_range_queries(Catalog *catalog) {
+    reset_test_environment(catalog);
+    const int sort_by_quantity = 3;
+    const int sort_by_price = 4;
+
+    if (add_product(catalog, "N1", "Bolt", 12, 500) != 0 || add_product(catalog, "N2", "Nut", 3, 50) != 0 ||
+        add_product(catalog, "N3", "Washer", 0, 20) != 0 || add_product(catalog, "N4", "Screw", 7, 70) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+
+    const char *low_stock[] = {"N3", "N2", "N4"};
+    const char *mid_price[] = {"N2", "N4"};
+    if (expect_range_ids(catalog, sort_by_quantity, INT_MIN, 10, low_stock, 3) != 0 ||
+        expect_range_ids(catalog, sort_by_price, 50, 499, mid_price, 2) != 0 ||
+        expect_range_ids(catalog, sort_by_quantity, 13, INT_MAX, NULL, 0) != 0 ||
+        expect_range_ids(catalog, sort_by_quantity, 5, 4, NULL, 0) != 0) {
+        return 1;
+    }
+
+    // Restocking and selling move rows in and out of the range through the maintained index
+    if (update_product(catalog, "N2", NULL, 40, -1) != 0 || update_product(catalog, "N1", NULL, 1, -1) != 0 ||
+        remove_product(catalog, "N3") != 0) {
+        printf("    Failed to update stock\n");
+        return 1;
+    }
+    const char *after[] = {"N1", "N4"};
+    if (expect_range_ids(catalog, sort_by_quantity, INT_MIN, 10, after, 2) != 0) {
+        return 1;
+    }
+
+    int *matches = NULL;
+    if (find_products_in_range(catalog, 1, 0, 10, &matches) != -1 || matches != NULL) {
+        printf("    Range query on a non-numeric column was accepted\n");
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    char keys[8][20];
+    int count;
+} ArtTestKeys;
+
+static int art_test_collect(const char *key, int value, void *ctx) {
+    (void)value;
+    ArtTestKeys *seen = (ArtTestKeys *)ctx;
+    if (seen->count < 8) {
+        strcpy(seen->keys[seen->count], key);
+    }
+    seen->count++;
+    return 0;
+}
+
+static int expect_art_prefix(const ArtTree *tree, const char *prefix, int fold_case, const char *const *expected, int count) {
+    ArtTestKeys seen;
+    memset(&seen, 0, sizeof(seen));
+    art_iterate_prefix(tree, prefix, fold_case, art_test_collect, &seen);
+    int ok = seen.count == count;
+    for (int i = 0; ok && i < count; i++) {
+        ok = strcmp(seen.keys[i], expected[i]) == 0;
+    }
+    if (!ok) {
+        printf("    Prefix \"%s\"%s listed %d keys, expected %d\n", prefix, fold_case ? " (any case)" : "", seen.count, count);
+    }
+    return ok ? 0 : 1;
+}
+
+static int test_radix_tree_indexes_product_ids(Catalog *catalog) {
+    ArtTree tree;
+    art_init(&tree);
+    const char *ids[] = {"ELEC-KB-002", "P001", "ELEC-KB-001", "ELEC-MS-001", "elec-kb-003", "P0010", "ELEC-KB-0010"};
+    int result = 0;
+    for (int i = 0; i < 7; i++) {
+        if (art_insert(&tree, ids[i], i) != 0) {
+            result = 1;
+        }
+    }
+    if (result != 0 || art_insert(&tree, "P001", 9) != 1 || art_size(&tree) != 7 ||
+        art_search(&tree, "P001") != 1 || art_search(&tree, "P00") != -1 || art_search(&tree, "ELEC-KB-0010") != 6) {
+        printf("    Insert or lookup failed\n");
+        art_free(&tree);
+        return 1;
+    }
+
+    // Byte order, so "P001" sorts before "P0010" and upper case before lower case
+    const char *kb[] = {"ELEC-KB-001", "ELEC-KB-0010", "ELEC-KB-002"};
+    const char *kb_any_case[] = {"ELEC-KB-001", "ELEC-KB-0010", "ELEC-KB-002", "elec-kb-003"};
+    const char *p[] = {"P001", "P0010"};
+    if (expect_art_prefix(&tree, "ELEC-KB", 0, kb, 3) != 0 ||
+        expect_art_prefix(&tree, "elec-kb", 1, kb_any_case, 4) != 0 ||
+        expect_art_prefix(&tree, "P001", 0, p, 2) != 0 ||
+        expect_art_prefix(&tree, "ELEC-X", 1, NULL, 0) != 0) {
+        art_free(&tree);
+        return 1;
+    }
+
+    // Removing row 2 shifts the rows after it down by one
+    if (art_delete(&tree, "ELEC-KB-001") != 2 || art_delete(&tree, "ELEC-KB-001") != -1) {
+        printf("    Delete failed\n");
+        result = 1;
+    }
+    art_shift_values(&tree, 3, -1);
+    if (result == 0 && (art_search(&tree, "ELEC-MS-001") != 2 || art_search(&tree, "P001") != 1 ||
+                        art_search(&tree, "ELEC-KB-0010") != 5 || art_size(&tree) != 6)) {
+        printf("    Values were not shifted\n");
+        result = 1;
+    }
+    art_free(&tree);
+    if (result != 0) {
+        return 1;
+    }
+
+    // The catalog keeps its own tree in step: lookups, id: filters and the ID-ordered save
+    reset_test_environment(catalog);
+    catalog_begin(catalog);
+    for (int i = 0; i < 7; i++) {
+        add_product(catalog, ids[i], "Part", i, i);
+    }
+    if (catalog_commit(catalog) != 0 || add_product(catalog, "P001", "Again", 1, 1) == 0 || remove_product(catalog, "ELEC-KB-001") != 0 ||
+        update_product(catalog, "ELEC-MS-001", "Mouse", 5, 5) != 0 || add_product(catalog, "ELEC-KB-000", "Part", 1, 1) != 0) {
+        printf("    Catalog mutations through the ID index failed\n");
+        return 1;
+    }
+    if (expect_query_ids(catalog, "id:elec-kb", 0, 0, "ELEC-KB-002", "ELEC-KB-000", 4) != 0 ||
+        expect_query_ids(catalog, "id=p001", 0, 1, "P001", "P001", 1) != 0) {
+        return 1;
+    }
+
+    if (save_csv(catalog, TEST_SORTED_FILE) != 0) {
+        printf("    Failed to save\n");
+        return 1;
+    }
+    const char *sorted[] = {"ELEC-KB-000", "ELEC-KB-0010", "ELEC-KB-002", "ELEC-MS-001", "P001", "P0010", "elec-kb-003"};
+    FILE *fp = fopen(TEST_SORTED_FILE, "r");
+    char line[256];
+    int row = -1;
+    while (fp && fgets(line, sizeof(line), fp)) {
+        if (row >= 0 && (row >= 7 || strncmp(line, sorted[row], strlen(sorted[row])) != 0 || line[strlen(sorted[row])] != ',')) {
+            printf("    Saved row %d out of ID order: %s", row, line);
+            result = 1;
+            break;
+        }
+        row++;
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    remove(TEST_SORTED_FILE);
+    if (result == 0 && row != 7) {
+        printf("    Expected 7 saved rows, got %d\n", row);
+        result = 1;
+    }
+    return result;
+}
+
+static int test_fuzzy_filter_tolerates_typos(Catalog *catalog) {
+    FuzzyPattern pattern;
+    if (fuzzy_compile(&pattern, "keyboard") != 0 ||
+        fuzzy_distance(&pattern, "Wireless KEYBOARD") != 0 ||
+        fuzzy_distance(&pattern, "keybaord") != 2 ||
+        fuzzy_distance(&pattern, "Keybord stand") != 1 ||
+        !fuzzy_contains(&pattern, "keybrd", 2) || fuzzy_contains(&pattern, "keybrd", 1) ||
+        fuzzy_compile(&pattern, "") != 1) {
+        printf("    Edit distances are wrong\n");
+        return 1;
+    }
+
+    Query query;
+    if (query_parse("keybaord~ mose~1 ab~ \"usb~\"", &query) != 4 ||
+        query.terms[0].field != QUERY_FUZZY || query.terms[0].max_edits != 2 ||
+        strcmp(query.terms[0].text, "keybaord") != 0 ||
+        query.terms[1].field != QUERY_FUZZY || query.terms[1].max_edits != 1 ||
+        query.terms[2].field != QUERY_FUZZY || query.terms[2].max_edits != 0 ||
+        query.terms[3].field != QUERY_TEXT) {
+        printf("    Fuzzy terms parsed incorrectly\n");
+        return 1;
+    }
+    char fuzzy[128];
+    if (query_make_fuzzy("keybaord  qty<5 \"usb cable\" id:P0 mouse~1", fuzzy, sizeof(fuzzy)) != 0 ||
+        strcmp(fuzzy, "keybaord~ qty<5 \"usb cable\" id:P0 mouse~1") != 0 ||
+        query_make_fuzzy("keyboard", fuzzy, 8) != 1) {
+        printf("    Fuzzy mode rewrote the filter incorrectly\n");
+        return 1;
+    }
+
+    reset_test_environment(catalog);
+    catalog_begin(catalog);
+    add_product(catalog, "F1", "Wireless Keybord", 1, 10);
+    add_product(catalog, "F2", "Keyboard", 2, 20);
+    add_product(catalog, "F3", "Mouse", 3, 30);
+    add_product(catalog, "F4", "Keyboad Cover", 4, 40);
+    add_product(catalog, "F5", "Kibord", 5, 50);
+    if (catalog_commit(catalog) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+    const int sort_by_row = 0;
+    if (expect_query_ids(catalog, "keybaord", sort_by_row, 0, NULL, NULL, 0) != 0 ||
+        expect_query_ids(catalog, "keybaord~", sort_by_row, 0, "F1", "F4", 3) != 0 ||
+        expect_query_ids(catalog, "keyboard~", sort_by_row, 0, "F1", "F4", 3) != 0 ||
+        expect_query_ids(catalog, "keyboard~ qty>=2", sort_by_row, 0, "F2", "F4", 2) != 0 ||
+        expect_query_ids(catalog, "keyboard~3", sort_by_row, 0, "F1", "F5", 4) != 0) {
+        return 1;
+    }
+    // Exact matches rank first, then by the number of typos
+    int rows[4];
+    const char *ranked[] = {"F2", "F1", "F4", "F5"};
+    if (find_products_ranked(catalog, "keyboard~3", 0, 4, rows) != 4) {
+        printf("    Ranked fuzzy search returned too few rows\n");
+        return 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(catalog->products[rows[i]].ProductID, ranked[i]) != 0) {
+            printf("    Rank %d is %s, expected %s\n", i, catalog->products[rows[i]].ProductID, ranked[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_regex_and_glob_filters_run_as_dfas(Catalog *catalog) {
+    Dfa dfa;
+    if (dfa_compile_regex(&dfa, "kb-\\d+$") != 0 ||
+        !dfa_matches(&dfa, "KB-12") || dfa_matches(&dfa, "kb-12x") || dfa_matches(&dfa, "kb-") ||
+        strcmp(dfa.literal, "kb-") != 0) {
+        printf("    Regex compiled incorrectly\n");
+        dfa_free(&dfa);
+        return 1;
+    }
+    dfa_free(&dfa);
+    if (dfa_compile_glob(&dfa, "elec-?0[!2]") != 0 ||
+        !dfa_matches(&dfa, "ELEC-001") || dfa_matches(&dfa, "ELEC-002") || dfa_matches(&dfa, "xELEC-001") ||
+        strcmp(dfa.literal, "elec-") != 0) {
+        printf("    Glob compiled incorrectly\n");
+        dfa_free(&dfa);
+        return 1;
+    }
+    dfa_free(&dfa);
+    // Nested stars must not blow up: every byte is read once
+    char text[4096];
+    memset(text, 'a', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    if (dfa_compile_regex(&dfa, "^(a*)*b") != 0 || dfa_matches(&dfa, text)) {
+        printf("    Pathological regex matched\n");
+        dfa_free(&dfa);
+        return 1;
+    }
+    dfa_free(&dfa);
+    if (dfa_compile_regex(&dfa, "(ab") != 1 || dfa_compile_regex(&dfa, "a)") != 1) {
+        printf("    Malformed regex compiled\n");
+        return 1;
+    }
+
+    Query query;
+    if (query_parse("/Ca(ble|rd)/ ELEC-* usb? \"a*b\" //", &query) != 5 ||
+        query.terms[0].field != QUERY_REGEX || strcmp(query.terms[0].text, "Ca(ble|rd)") != 0 ||
+        query.terms[1].field != QUERY_GLOB || strcmp(query.terms[1].text, "ELEC-*") != 0 ||
+        query.terms[2].field != QUERY_GLOB ||
+        query.terms[3].field != QUERY_TEXT || query.terms[4].field != QUERY_TEXT) {
+        printf("    Regex and glob terms parsed incorrectly\n");
+        return 1;
+    }
+
+    reset_test_environment(catalog);
+    catalog_begin(catalog);
+    add_product(catalog, "ELEC-001", "USB Cable", 1, 10);
+    add_product(catalog, "ELEC-002", "SD Card", 2, 20);
+    add_product(catalog, "HOME-001", "Cable Tidy", 3, 30);
+    add_product(catalog, "KB-12", "Keyboard", 4, 40);
+    if (catalog_commit(catalog) != 0) {
+        printf("    Failed to seed products\n");
+        return 1;
+    }
+    const int sort_by_row = 0;
+    if (expect_query_ids(catalog, "/ca(ble|rd)/", sort_by_row, 0, "ELEC-001", "HOME-001", 3) != 0 ||
+        expect_query_ids(catalog, "/^cable/", sort_by_row, 0, "HOME-001", "HOME-001", 1) != 0 ||
+        expect_query_ids(catalog, "elec-*", sort_by_row, 0, "ELEC-001", "ELEC-002", 2) != 0 ||
+        expect_query_ids(catalog, "*-00? qty>=2", sort_by_row, 0, "ELEC-002", "HOME-001", 2) != 0 ||
+        expect_query_ids(catalog, "/kb-\\d+$/ key", sort_by_row, 0, "KB-12", "KB-12", 1) != 0 ||
+        expect_query_ids(catalog, "/usb(/", sort_by_row, 0, NULL, NULL, 0) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+#define TEST_PARALLEL_ITEMS 100003
+#define TEST_PARALLEL_PARTS 7
+#define TEST_PARALLEL_ROWS 50000
+
+typedef struct {
+    unsigned char visits[TEST_PARALLEL_ITEMS];
+    int begin[TEST_PARALLEL_PARTS];
+    int end[TEST_PARALLEL_PARTS];
+} ParallelCoverage;
+
+static void record_parallel_part(int part, int begin, int end, void *ctx) {
+    ParallelCoverage *coverage = (ParallelCoverage *)ctx;
+    coverage->begin[part] = begin;
+    coverage->end[part] = end;
+    for (int i = begin; i < end; i++) {
+        coverage->visits[i]++;
+    }
+}
+
+static int test_parallel_scan_merges_parts_in_order(Catalog *catalog) {
+    if (parallel_partitions(1000, 16384) != 1 ||
+        parallel_partitions(1 << 24, 16384) != parallel_thread_count()) {
+        printf("    Small inputs must stay on one thread, large ones use every thread\n");
+        return 1;
+    }
+    ParallelCoverage *coverage = (ParallelCoverage *)calloc(1, sizeof(ParallelCoverage));
+    if (!coverage) {
+        printf("    Out of memory\n");
+        return 1;
+    }
+    parallel_for(TEST_PARALLEL_ITEMS, TEST_PARALLEL_PARTS, record_parallel_part, coverage);
+    int failed = coverage->begin[0] != 0 || coverage->end[TEST_PARALLEL_PARTS - 1] != TEST_PARALLEL_ITEMS;
+    for (int part = 1; part < TEST_PARALLEL_PARTS; part++) {
+        failed |= coverage->begin[part] != coverage->end[part - 1];
+    }
+    for (int i = 0; i < TEST_PARALLEL_ITEMS; i++) {
+        failed |= coverage->visits[i] != 1;
+    }
+    free(coverage);
+    if (failed) {
+        printf("    Parts did not cover every item exactly once, in order\n");
+        return 1;
+    }
+
+    // Big enough to be split on a multi-core machine; results must not depend on the split
+    reset_test_environment(catalog);
+    catalog->products = (Product *)malloc(TEST_PARALLEL_ROWS * sizeof(Product));
+    if (!catalog->products) {
+        printf("    Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < TEST_PARALLEL_ROWS; i++) {
+        snprintf(catalog->products[i].ProductID, sizeof(catalog->products[i].ProductID), "PAR%05d", i);
+        snprintf(catalog->products[i].ProductName, sizeof(catalog->products[i].ProductName), "%s %d",
+                 i % 7 == 0 ? "Gadget" : "Widget", i);
+        catalog->products[i].Quantity = TEST_PARALLEL_ROWS - i;
+        catalog->products[i].UnitPrice = i % 100;
+    }
+    catalog->product_count = TEST_PARALLEL_ROWS;
+    catalog->product_capacity = TEST_PARALLEL_ROWS;
+    catalog_indexes_invalidate(catalog);
+
+    const int gadgets = (TEST_PARALLEL_ROWS + 6) / 7;
+    int *matches = NULL;
+    int found = find_products_by_keyword(catalog, "GADGET", &matches);
+    failed = found != gadgets;
+    for (int i = 0; !failed && i < found; i++) {
+        failed = matches[i] != i * 7;
+    }
+    free(matches);
+    if (failed) {
+        printf("    Keyword scan returned %d rows, expected %d in row order\n", found, gadgets);
+        return 1;
+    }
+    const int sort_by_row = 0;
+    const int sort_by_quantity = 3;
+    char last[20];
+    snprintf(last, sizeof(last), "PAR%05d", (gadgets - 1) * 7);
+    if (expect_query_ids(catalog, "gadget", sort_by_row, 0, "PAR00000", last, gadgets) != 0 ||
+        expect_query_ids(catalog, "gadget", sort_by_quantity, 0, last, "PAR00000", gadgets) != 0 ||
+        expect_query_ids(catalog, "gadget price<10", sort_by_row, 1, "PAR49903", "PAR00000", 714) != 0) {
+        return 1;
+    }
+    const char *ranked[] = {"PAR00007", "PAR07000"};
+    int rows[2];
+    if (find_products_ranked(catalog, "par00007", 0, 2, rows) != 1 ||
+        strcmp(catalog->products[rows[0]].ProductID, ranked[0]) != 0 ||
+        find_products_ranked(catalog, "7000", 0, 2, rows) != 2 ||
+        strcmp(catalog->products[rows[0]].ProductID, ranked[1]) != 0) {
+        printf("    Ranked scan merged the parts' best matches incorrectly\n");
+        return 1;
+    }
+    return 0;
+}
+
+// rows products straight into the catalog: every seventh is a "Gadget", the rest "Widget"s
+static int fill_gadget_catalog(Catalog *catalog, int rows) {
+    reset_test_environment(catalog);
+    catalog->products = (Product *)malloc((size_t)rows * sizeof(Product));
+    if (!catalog->products) {
+        printf("    Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < rows; i++) {
+        snprintf(catalog->products[i].ProductID, sizeof(catalog->products[i].ProductID), "GAD%06d", i);
+        snprintf(catalog->products[i].ProductName, sizeof(catalog->products[i].ProductName), "%s %d",
+                 i % 7 == 0 ? "Gadget" : "Widget", i);
+        catalog->products[i].Quantity = i % 50;
+        catalog->products[i].UnitPrice = i % 100;
+    }
+    catalog->product_count = rows;
+    catalog->product_capacity = rows;
+    catalog_indexes_invalidate(catalog);
+    return 0;
+}
+
+#define TEST_SEARCH_MIN_PART 16384 // SEARCH_PARALLEL_MIN_ROWS
+#define TEST_SEARCH_STRIDE 256     // SEARCH_CHECKPOINT_STRIDE
+
+// Build "gadget" over rows products and check its matches page back as rows 0, 7, 14, ...,
+// the single-threaded order, including pages that straddle a checkpoint or a slice boundary
+static int expect_gadget_pages(Catalog *catalog, int rows, int *out_parts) {
+    const int gadgets = (rows + 6) / 7;
+    SearchResult *result = search_result_create();
+    int *page = (int *)malloc((size_t)gadgets * sizeof(int));
+    if (!result || !page) {
+        search_result_destroy(result);
+        free(page);
+        printf("    Out of memory\n");
+        return 1;
+    }
+
+    int failed = 0;
+    rwlock_read_lock(&catalog->lock);
+    int count = search_result_build(catalog, result, "gadget", 0, 0, NULL);
+    *out_parts = search_result_parts(result);
+    if (count != gadgets || search_result_page(catalog, result, 0, gadgets, page) != gadgets) {
+        printf("    Expected %d matches over %d rows, got %d\n", gadgets, rows, count);
+        failed = 1;
+    }
+    for (int i = 0; !failed && i < gadgets; i++) {
+        failed = page[i] != i * 7;
+    }
+    for (int offset = TEST_SEARCH_STRIDE - 3; !failed && offset < gadgets; offset += TEST_SEARCH_STRIDE) {
+        int got = search_result_page(catalog, result, offset, 7, page);
+        failed = got != (gadgets - offset < 7 ? gadgets - offset : 7);
+        for (int i = 0; !failed && i < got; i++) {
+            failed = page[i] != (offset + i) * 7;
+        }
+    }
+    for (int part = 1; !failed && part < *out_parts; part++) {
+        int begin;
+        int end;
+        parallel_part_range(rows, *out_parts, part, &begin, &end);
+        int first = (begin + 6) / 7; // first match of this slice
+        if (search_result_page(catalog, result, first - 1, 2, page) != 2 ||
+            page[0] != (first - 1) * 7 || page[1] != first * 7) {
+            failed = 1;
+        }
+    }
+    rwlock_read_unlock(&catalog->lock);
+    if (failed) {
+        printf("    Pages over %d rows in %d slices are out of order\n", rows, *out_parts);
+    }
+    search_result_destroy(result);
+    free(page);
+    return failed;
+}
+
+// Views below two minimum slices are scanned whole; larger ones split across the pool and
+// must page exactly like a single scan. Run with POM_THREADS above 1 to split on one core.
+static int test_search_split_matches_single_scan(Catalog *catalog) {
+    int parts = 0;
+    if (fill_gadget_catalog(catalog, 2 * TEST_SEARCH_MIN_PART - 1) != 0 ||
+        expect_gadget_pages(catalog, 2 * TEST_SEARCH_MIN_PART - 1, &parts) != 0) {
+        return 1;
+    }
+    if (parts != 1) {
+        printf("    A view under the threshold was split into %d slices\n", parts);
+        return 1;
+    }
+
+    const int rows = 4 * TEST_SEARCH_MIN_PART;
+    if (fill_gadget_catalog(catalog, rows) != 0 || expect_gadget_pages(catalog, rows, &parts) != 0) {
+        return 1;
+    }
+    if (parts != parallel_partitions(rows, TEST_SEARCH_MIN_PART) ||
+        (parallel_thread_count() > 1 && parts < 2)) {
+        printf("    %d rows on %d threads were scanned in %d slices\n", rows, parallel_thread_count(), parts);
+        return 1;
+    }
+    return 0;
+}
+
+#define TEST_PAGED_ROWS 3000
+#define TEST_PAGE_SIZE 23
+
+// Walk every page of a filtered view, the last one partial, and compare with the full list
+static int expect_pages_match_query(Catalog *catalog, const char *query, int sort_key, int descending) {
+    int *expected = NULL;
+    int count = find_products_by_query(catalog, query, sort_key, descending, &expected);
+    SearchResult *result = search_result_create();
+    if (count <= 2 * TEST_SEARCH_STRIDE || count % TEST_PAGE_SIZE == 0 || !result) {
+        printf("    \"%s\" needs over two checkpoints and a partial last page, got %d matches\n", query, count);
+        free(expected);
+        search_result_destroy(result);
+        return 1;
+    }
+
+    int failed = 0;
+    int page[TEST_PAGE_SIZE];
+    rwlock_read_lock(&catalog->lock);
+    failed = search_result_build(catalog, result, query, sort_key, descending, NULL) != count;
+    for (int offset = 0; !failed && offset < count; offset += TEST_PAGE_SIZE) {
+        int want = count - offset < TEST_PAGE_SIZE ? count - offset : TEST_PAGE_SIZE;
+        failed = search_result_page(catalog, result, offset, TEST_PAGE_SIZE, page) != want ||
+                 memcmp(page, expected + offset, (size_t)want * sizeof(int)) != 0;
+        if (failed) {
+            printf("    \"%s\" page at %d differs from the full result\n", query, offset);
+        }
+    }
+    if (!failed && search_result_page(catalog, result, count, TEST_PAGE_SIZE, page) != 0) {
+        printf("    \"%s\" paged past its last match\n", query);
+        failed = 1;
+    }
+    rwlock_read_unlock(&catalog->lock);
+    free(expected);
+    search_result_destroy(result);
+    return failed;
+}
+
+static int test_search_pages_match_full_results(Catalog *catalog) {
+    const int sort_by_row = 0;
+    const int sort_by_price = 4;
+    if (fill_gadget_catalog(catalog, TEST_PAGED_ROWS) != 0) {
+        return 1;
+    }
+    // A residual filter on each order: pages resume from the checkpoint before them
+    if (expect_pages_match_query(catalog, "widget", sort_by_row, 0) != 0 ||
+        expect_pages_match_query(catalog, "widget", sort_by_price, 1) != 0 ||
+        expect_pages_match_query(catalog, "widget qty>=10", sort_by_price, 0) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+#define TEST_SEARCH_JOB_ROWS 60000
+
+// Wait for job to finish and take its result; 0 when it did not finish within a few seconds
+static int collect_search_job(SearchJob *job, SearchResult *result, int *status) {
+    for (int waited = 0; waited < 500; waited++) {
+        if (search_job_collect(job, result, status)) {
+            return 1;
+        }
+        event_loop_wait_input(-1, 10); // the worker's completion post ends the wait early
+    }
+    return 0;
+}
+
+// A job replaced or cancelled mid-scan never delivers; the newest one does
+static int test_search_job_drops_stale_results(Catalog *catalog) {
+    if (fill_gadget_catalog(catalog, TEST_SEARCH_JOB_ROWS) != 0) {
+        return 1;
+    }
+    const int sort_by_row = 0;
+    const int gadgets = (TEST_SEARCH_JOB_ROWS + 6) / 7;
+    SearchJob *job = search_job_create();
+    SearchResult *result = search_result_create();
+    if (!job || !result) {
+        search_job_destroy(job);
+        search_result_destroy(result);
+        printf("    Out of memory\n");
+        return 1;
+    }
+
+    int status = 0;
+    int failed = 0;
+    if (search_job_start(job, catalog, "widget", sort_by_row, 0) != 0) {
+        printf("    Search job did not start\n");
+        failed = 1;
+    } else {
+        search_job_cancel(job);
+        if (search_job_collect(job, result, &status)) {
+            printf("    A cancelled job still delivered a result\n");
+            failed = 1;
+        }
+    }
+
+    // "widget" is still scanning or already done when "gadget" replaces it; either way only
+    // the gadget matches may come back
+    if (!failed && (search_job_start(job, catalog, "widget", sort_by_row, 0) != 0 ||
+                    search_job_start(job, catalog, "gadget", sort_by_row, 0) != 0)) {
+        printf("    Replacement job did not start\n");
+        failed = 1;
+    }
+    if (!failed && (!collect_search_job(job, result, &status) || status != gadgets)) {
+        printf("    Expected the %d gadget matches, got %d\n", gadgets, status);
+        failed = 1;
+    }
+    int rows[2];
+    rwlock_read_lock(&catalog->lock);
+    if (!failed && (search_result_page(catalog, result, gadgets - 2, 2, rows) != 2 ||
+                    rows[0] != (gadgets - 2) * 7 || rows[1] != (gadgets - 1) * 7)) {
+        printf("    Delivered result does not page the gadget rows\n");
+        failed = 1;
+    }
+    rwlock_read_unlock(&catalog->lock);
+    if (!failed && search_job_collect(job, result, &status)) {
+        printf("    A result was delivered twice\n");
+        failed = 1;
+    }
+
+    search_job_destroy(job);
+    search_result_destroy(result);
+    // Drop the workers' completion posts so later waits start clean
+    while (event_loop_wait_input(-1, 0) == EVENT_LOOP_REDRAW) {
+        continue;
+    }
+    return failed;
+}
+
+#define TEST_POOL_DEPTH 10
+
+typedef struct {
+    int depth;
+    int *visits;
+} PoolNode;
+
+// Each node spawns its two children and waits for them, so waits nest TEST_POOL_DEPTH deep
+static void visit_pool_node(void *arg) {
+    PoolNode *node = (PoolNode *)arg;
+    __atomic_add_fetch(node->visits, 1, __ATOMIC_RELAXED);
+    if (node->depth == 0) {
+        return;
+    }
+    PoolNode left = {node->depth - 1, node->visits};
+    PoolNode right = {node->depth - 1, node->visits};
+    ParallelGroup group;
+    parallel_group_init(&group);
+    parallel_spawn(&group, visit_pool_node, &left);
+    parallel_spawn(&group, visit_pool_node, &right);
+    parallel_wait(&group);
+}
+
+static int test_thread_pool_runs_nested_groups(Catalog *catalog) {
+    int visits = 0;
+    PoolNode roots[600];
+    ParallelGroup group;
+    parallel_group_init(&group);
+    // More tasks than a deque holds: the overflow runs on the spawning thread
+    for (int i = 0; i < 600; i++) {
+        roots[i].depth = i == 0 ? TEST_POOL_DEPTH : 0;
+        roots[i].visits = &visits;
+        parallel_spawn(&group, visit_pool_node, &roots[i]);
+    }
+    parallel_wait(&group);
+    if (visits != (1 << (TEST_POOL_DEPTH + 1)) - 1 + 599) {
+        printf("    Pool ran %d tasks\n", visits);
+        return 1;
+    }
+    if (parallel_configure(2) != 1 || parallel_configure(-1) != 1 ||
+        parallel_configure(PARALLEL_MAX_THREADS + 1) != 1 || parallel_thread_count() < 1) {
+        printf("    Thread count changed while the pool was running\n");
+        return 1;
+    }
+
+    // Save and load a catalog large enough to be formatted and parsed in parts
+    reset_test_environment(catalog);
+    catalog->products = (Product *)malloc(TEST_PARALLEL_ROWS * sizeof(Product));
+    if (!catalog->products) {
+        printf("    Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < TEST_PARALLEL_ROWS; i++) {
+        snprintf(catalog->products[i].ProductID, sizeof(catalog->products[i].ProductID), "CSV%05d", TEST_PARALLEL_ROWS - 1 - i);
+        snprintf(catalog->products[i].ProductName, sizeof(catalog->products[i].ProductName), i % 3 == 0 ? "Item, \"%d\"" : "Item %d", i);
+        catalog->products[i].Quantity = i;
+        catalog->products[i].UnitPrice = i % 100;
+    }
+    catalog->product_count = TEST_PARALLEL_ROWS;
+    catalog->product_capacity = TEST_PARALLEL_ROWS;
+    catalog_indexes_invalidate(catalog);
+    Product *saved = (Product *)malloc(TEST_PARALLEL_ROWS * sizeof(Product));
+    if (!saved || save_csv(catalog, TEST_PARALLEL_FILE) != 0) {
+        free(saved);
+        printf("    Failed to save the catalog\n");
+        return 1;
+    }
+    memcpy(saved, catalog->products, TEST_PARALLEL_ROWS * sizeof(Product));
+
+    reset_test_environment(catalog);
+    int rc = load_csv(catalog, TEST_PARALLEL_FILE);
+    remove(TEST_PARALLEL_FILE);
+    int failed = rc != 0 || catalog->product_count != TEST_PARALLEL_ROWS;
+    // Saved in ProductID order, which reverses the rows
+    for (int i = 0; !failed && i < TEST_PARALLEL_ROWS; i++) {
+        const Product *original = &saved[TEST_PARALLEL_ROWS - 1 - i];
+        failed = strcmp(catalog->products[i].ProductID, original->ProductID) != 0 ||
+                 strcmp(catalog->products[i].ProductName, original->ProductName) != 0 ||
+                 catalog->products[i].Quantity != original->Quantity || catalog->products[i].UnitPrice != original->UnitPrice;
+        if (failed) {
+            printf("    Row %d came back as %s/%s\n", i, catalog->products[i].ProductID, catalog->products[i].ProductName);
+        }
+    }
+    free(saved);
+    if (failed) {
+        printf("    CSV round trip lost rows (%d loaded)\n", catalog->product_count);
+        return 1;
+    }
+    return 0;
+}
+
+#define TEST_STRESS_ROWS 2000
+#define TEST_STRESS_READERS 3
+#define TEST_STRESS_CYCLES 150
+
+typedef struct {
+    pthread_t thread;
+    Catalog *catalog;
+    int id;
+    int *stop;
+    int passes;
+    int failures;
+} StressReader;
+
+// Query every way the catalog can be read while the main thread commits. Each commit adds
+// and removes one "Stress" row and bumps a Base row's quantity, so a reader that sees a
+// half-applied commit finds the wrong number of rows.
+static void *stress_reader(void *arg) {
+    StressReader *reader = (StressReader *)arg;
+    Catalog *catalog = reader->catalog;
+    char export_path[64];
+    snprintf(export_path, sizeof(export_path), "ut_stress_%d.csv", reader->id);
+    const int sort_by_quantity = 3;
+    while (!__atomic_load_n(reader->stop, __ATOMIC_ACQUIRE) || reader->passes == 0) {
+        int *matches = NULL;
+        int found = find_products_by_keyword(catalog, "base", &matches);
+        free(matches);
+        int failed = found != TEST_STRESS_ROWS;
+
+        matches = NULL;
+        found = find_products_by_query(catalog, "base qty>=0", sort_by_quantity, reader->id % 2, &matches);
+        free(matches);
+        failed |= found != TEST_STRESS_ROWS;
+
+        int rows[2];
+        found = find_products_ranked(catalog, "stress", 0, 2, rows);
+        failed |= found != 0 && found != 1;
+        failed |= catalog_sorted_row(catalog, sort_by_quantity, 0, 0) < 0;
+
+        if (save_csv(catalog, export_path) != 0) {
+            failed = 1;
+        } else {
+            int saved = count_csv_rows(export_path);
+            failed |= saved != TEST_STRESS_ROWS && saved != TEST_STRESS_ROWS + 1;
+        }
+        reader->failures += failed;
+        reader->passes++;
+    }
+    remove(export_path);
+    return NULL;
+}
+
+typedef struct {
+    Catalog *catalog;
+    int rc;
+} WaitingWriter;
+
+static void *add_while_other_transaction_open(void *arg) {
+    WaitingWriter *writer = (WaitingWriter *)arg;
+    writer->rc = add_product(writer->catalog, "TXW01", "Other thread", 1, 1);
+    return NULL;
+}
+
+static int test_catalog_serves_readers_during_writes(Catalog *catalog) {
+    catalog->products = (Product *)malloc(TEST_STRESS_ROWS * sizeof(Product));
+    if (!catalog->products) {
+        printf("    Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < TEST_STRESS_ROWS; i++) {
+        snprintf(catalog->products[i].ProductID, sizeof(catalog->products[i].ProductID), "BASE%04d", i);
+        snprintf(catalog->products[i].ProductName, sizeof(catalog->products[i].ProductName), "Base %d", i);
+        catalog->products[i].Quantity = i;
+        catalog->products[i].UnitPrice = 10;
+    }
+    catalog->product_count = TEST_STRESS_ROWS;
+    catalog->product_capacity = TEST_STRESS_ROWS;
+    catalog_indexes_invalidate(catalog);
+
+    int stop = 0;
+    StressReader readers[TEST_STRESS_READERS];
+    int started = 0;
+    for (int i = 0; i < TEST_STRESS_READERS; i++) {
+        readers[i].catalog = catalog;
+        readers[i].id = i;
+        readers[i].stop = &stop;
+        readers[i].passes = 0;
+        readers[i].failures = 0;
+        if (pthread_create(&readers[i].thread, NULL, stress_reader, &readers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    int failed = started != TEST_STRESS_READERS;
+    for (int cycle = 0; !failed && cycle < TEST_STRESS_CYCLES; cycle++) {
+        char base_id[20];
+        snprintf(base_id, sizeof(base_id), "BASE%04d", cycle % TEST_STRESS_ROWS);
+        catalog_begin(catalog);
+        failed = add_product(catalog, "STRESS01", "Stress item", cycle, 1) != 0 ||
+                 update_product(catalog, base_id, NULL, TEST_STRESS_ROWS + cycle, -1) != 0 ||
+                 catalog_commit(catalog) != 0 ||
+                 remove_product(catalog, "STRESS01") != 0;
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; i++) {
+        pthread_join(readers[i].thread, NULL);
+        if (readers[i].failures > 0) {
+            printf("    Reader %d saw a half-applied commit in %d of %d passes\n",
+                   i, readers[i].failures, readers[i].passes);
+            failed = 1;
+        }
+    }
+    if (failed) {
+        printf("    Concurrent reads and commits disagreed\n");
+        return 1;
+    }
+
+    // A second thread's edit waits for the open transaction, then sees its result
+    WaitingWriter writer = {catalog, -1};
+    pthread_t thread;
+    catalog_begin(catalog);
+    if (pthread_create(&thread, NULL, add_while_other_transaction_open, &writer) != 0) {
+        catalog_rollback(catalog);
+        printf("    Failed to start the second writer\n");
+        return 1;
+    }
+    add_product(catalog, "TXW01", "Main thread", 2, 2);
+    int rc = catalog_commit(catalog);
+    pthread_join(thread, NULL);
+    int *matches = NULL;
+    int found = find_products_by_keyword(catalog, "TXW01", &matches);
+    failed = rc != 0 || writer.rc != 1 || found != 1 ||
+             strcmp(catalog->products[matches[0]].ProductName, "Main thread") != 0;
+    free(matches);
+    if (failed) {
+        printf("    Second writer did not wait for the open transaction\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void test_shard_path(int shard, char *buf, size_t size) {
+    snprintf(buf, size, "ut_shards.%d-of-%d.csv", shard, TEST_SHARD_COUNT);
+}
+
+// Return the shard file holding ProductID, or -1
+static int find_shard_containing(const char *ProductID) {
+    for (int shard = 0; shard < TEST_SHARD_COUNT; shard++) {
+        char path[64];
+        test_shard_path(shard, path, sizeof(path));
+        FILE *fp = fopen(path, "r");
+        if (!fp) {
+            continue;
+        }
+        char line[256];
+        size_t id_len = strlen(ProductID);
+        while (fgets(line, sizeof(line), fp)) {
+            if (strncmp(line, ProductID, id_len) == 0 && line[id_len] == ',') {
+                fclose(fp);
+                return shard;
+            }
+        }
+        fclose(fp);
+    }
+    return -1;
+}
+
+static int run_sharded_scenario(Catalog *catalog) {
+    catalog_begin(catalog);
+    for (int i = 0; i < 8; i++) {
+        char id[20];
+        char name[100];
+        snprintf(id, sizeof(id), "SH%03d", i);
+        snprintf(name, sizeof(name), "Shard Item %d", i);
+        add_product(catalog, id, name, i, i * 100);
+    }
+    if (catalog_commit(catalog) != 0) {
+        printf("    Sharded commit failed\n");
+        return 1;
+    }
+
+    int total_rows = 0;
+    for (int shard = 0; shard < TEST_SHARD_COUNT; shard++) {
+        char path[64];
+        test_shard_path(shard, path, sizeof(path));
+        int rows = count_csv_rows(path);
+        if (rows < 0) {
+            printf("    Missing shard file %s\n", path);
+            return 1;
+        }
+        total_rows += rows;
+    }
+    if (total_rows != 8) {
+        printf("    Expected 8 rows across shards, got %d\n", total_rows);
+        return 1;
+    }
+
+    int target_shard = find_shard_containing("SH003");
+    int untouched_shard = (target_shard + 1) % TEST_SHARD_COUNT;
+    char untouched_path[64];
+    test_shard_path(untouched_shard, untouched_path, sizeof(untouched_path));
+    int untouched_rows = count_csv_rows(untouched_path);
+    remove(untouched_path);
+
+    if (update_product(catalog, "SH003", "Shard Item 3 Updated", 33, -1) != 0) {
+        printf("    Sharded update failed\n");
+        return 1;
+    }
+    if (find_shard_containing("SH003") != target_shard) {
+        printf("    Updated row moved to another shard\n");
+        return 1;
+    }
+    FILE *probe = fopen(untouched_path, "r");
+    if (probe) {
+        fclose(probe);
+        printf("    Update rewrote a shard it does not belong to\n");
+        return 1;
+    }
+
+    reset_test_environment(catalog);
+    if (load_catalog(catalog) != 0) {
+        printf("    load_catalog failed for sharded layout\n");
+        return 1;
+    }
+    if (catalog->product_count != 8 - untouched_rows) {
+        printf("    Expected %d rows after reload, got %d\n", 8 - untouched_rows, catalog->product_count);
+        return 1;
+    }
+
+    if (save_csv(catalog, TEST_EXPORT_FILE) != 0 || count_csv_rows(TEST_EXPORT_FILE) != catalog->product_count) {
+        printf("    Export to a single CSV lost rows\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_sharded_catalog_touches_one_shard(Catalog *catalog) {
+    if (catalog_configure(catalog, TEST_SHARD_BASE, TEST_SHARD_COUNT) != 0) {
+        printf("    catalog_configure rejected shard layout\n");
+        return 1;
+    }
+
+    int result = run_sharded_scenario(catalog);
+
+    for (int shard = 0; shard < TEST_SHARD_COUNT; shard++) {
+        char path[64];
+        test_shard_path(shard, path, sizeof(path));
+        remove(path);
+    }
+    remove(TEST_EXPORT_FILE);
+    catalog_configure(catalog, TEST_PRODUCTS_FILE, 0);
+    return result;
+}
+
+static int count_layout_rows(int shard_count) {
+    int total = 0;
+    for (int shard = 0; shard < shard_count; shard++) {
+        char path[64];
+        snprintf(path, sizeof(path), "ut_shards.%d-of-%d.csv", shard, shard_count);
+        int rows = count_csv_rows(path);
+        if (rows < 0) {
+            return -1;
+        }
+        total += rows;
+    }
+    return total;
+}
+
+static int run_reshard_scenario(Catalog *catalog) {
+    catalog_begin(catalog);
+    for (int i = 0; i < 8; i++) {
+        char id[20];
+        snprintf(id, sizeof(id), "RS%03d", i);
+        add_product(catalog, id, "Reshard Item", i, i * 10);
+    }
+    if (catalog_commit(catalog) != 0 || count_layout_rows(TEST_SHARD_COUNT) != 8) {
+        printf("    Could not set up the %d-way layout\n", TEST_SHARD_COUNT);
+        return 1;
+    }
+
+    // A query (--shards 2 --query) reads the existing layout and leaves it where it is
+    Catalog query;
+    catalog_init(&query);
+    int loaded = catalog_configure(&query, TEST_SHARD_BASE, 2) == 0 && load_catalog_cached(&query) == 0 ? query.product_count : -1;
+    catalog_free(&query);
+    if (loaded != 8 || count_layout_rows(TEST_SHARD_COUNT) != 8 || count_layout_rows(2) >= 0) {
+        printf("    A query did not read the %d-way layout in place (%d rows)\n", TEST_SHARD_COUNT, loaded);
+        return 1;
+    }
+
+    catalog_configure(catalog, TEST_SHARD_BASE, 2);
+    reset_test_environment(catalog);
+    if (load_catalog(catalog) != 0 || catalog->product_count != 8) {
+        printf("    Changing --shards did not load the existing %d-way layout\n", TEST_SHARD_COUNT);
+        return 1;
+    }
+    if (count_layout_rows(2) != 8) {
+        printf("    Rows were not migrated to the 2-way layout\n");
+        return 1;
+    }
+    if (count_layout_rows(TEST_SHARD_COUNT) >= 0) {
+        printf("    The old %d-way layout was left behind\n", TEST_SHARD_COUNT);
+        return 1;
+    }
+
+    // The single CSV does not exist, so the shards are the only current copy
+    catalog_configure(catalog, TEST_SHARD_BASE, 0);
+    reset_test_environment(catalog);
+    if (load_catalog(catalog) == 0) {
+        printf("    Single-file mode ignored newer shards\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_shard_count_change_migrates_layout(Catalog *catalog) {
+    catalog_configure(catalog, TEST_SHARD_BASE, TEST_SHARD_COUNT);
+
+    int result = run_reshard_scenario(catalog);
+
+    for (int shard = 0; shard < TEST_SHARD_COUNT; shard++) {
+        char path[64];
+        test_shard_path(shard, path, sizeof(path));
+        remove(path);
+        snprintf(path, sizeof(path), "ut_shards.%d-of-2.csv", shard);
+        remove(path);
+    }
+    catalog_configure(catalog, TEST_PRODUCTS_FILE, 0);
+    return result;
+}
+
+typedef int (*TestFunc)(Catalog *catalog);
+
+typedef struct {
+    const char *name;
+    TestFunc func;
+} TestCase;
+
+int run_unit_tests(void) {
+    FileBackup file_backup;
+    if (backup_products_file(&file_backup, TEST_PRODUCTS_FILE) != 0) {
+        printf("Failed to back up %s.\n", TEST_PRODUCTS_FILE);
+        return 1;
+    }
+
+    const TestCase tests[] = {
+        {"add_product inserts new entry", test_add_product_inserts_new_entry},
+        {"add_product rejects duplicate IDs", test_add_product_rejects_duplicate_id},
+        {"add_product expands capacity", test_add_product_expands_capacity},
+        {"add_product accepts zero values", test_add_product_accepts_zero_values},
+        {"add_product handles INT_MAX values", test_add_product_handles_large_values},
+        {"add_product rejects empty name", test_add_product_rejects_empty_name},
+        {"add_product rejects whitespace name", test_add_product_rejects_whitespace_name},
+        {"add_product handles max-length strings", test_add_product_handles_max_length_strings},
+        {"add_product persists data to CSV", test_add_product_persists_to_csv},
+        {"add_product appends after manual seed", test_add_product_appends_after_manual_seed},
+        {"update_product changes all fields", test_update_product_changes_fields},
+        {"update_product supports partial updates", test_update_product_handles_partial_updates},
+        {"update_product fails for missing ID", test_update_product_missing_id_fails},
+        {"update_product fails with empty inventory", test_update_product_empty_inventory_fails},
+        {"update_product handles INT_MAX values", test_update_product_handles_max_values},
+        {"update_product ignores negative numbers", test_update_product_rejects_negative_numbers},
+        {"update_product sets zero values", test_update_product_sets_zero_values},
+        {"update_product preserves other records", test_update_product_preserves_other_records},
+        {"update_product rejects empty name", test_update_product_rejects_empty_name},
+        {"transaction commit persists batch", test_transaction_commit_persists_batch},
+        {"transaction rollback discards changes", test_transaction_rollback_discards_changes},
+        {"transaction commit is atomic", test_transaction_commit_is_atomic},
+        {"remove_product persists to CSV", test_remove_product_persists_to_csv},
+        {"catalogs are independent", test_catalogs_are_independent},
+        {"search across catalogs merges and routes", test_search_across_catalogs},
+        {"command file applies as one batch", test_command_file_applies_as_one_batch},
+        {"query output in csv, tsv and json", test_query_output_formats},
+        {"reload applies keyed diff", test_reload_applies_keyed_diff},
+        {"reload keeps indexes for a small diff", test_reload_keeps_indexes_for_small_diff},
+        {"file watch detects external write", test_file_watch_detects_external_write},
+        {"event loop dispatches timers, posts and input", test_event_loop_dispatches_events},
+        {"screen writes only changed lines", test_screen_writes_only_changed_lines},
+        {"screen scrolls list by one row", test_screen_scrolls_list_by_one_row},
+        {"read_menu_key decodes escape sequences", test_read_menu_key_decodes_sequences},
+        {"pasted filter runs one search", test_pasted_filter_runs_one_search},
+        {"order-statistic tree tracks order and ranks", test_ostree_tracks_order_and_ranks},
+        {"sorted view follows add/update/remove", test_sorted_view_follows_mutations},
+        {"ranked search orders by match quality", test_ranked_search_orders_by_match_quality},
+        {"query parser reads field tests", test_query_parser_reads_field_tests},
+        {"query filter plans use indexes and residual checks", test_query_filter_plans},
+        {"numeric range queries use the maintained indexes", test_numeric_range_queries},
+        {"radix tree indexes ProductIDs by prefix", test_radix_tree_indexes_product_ids},
+        {"fuzzy filter tolerates typos", test_fuzzy_filter_tolerates_typos},
+        {"regex and glob filters run as DFAs", test_regex_and_glob_filters_run_as_dfas},
+        {"parallel scan merges parts in order", test_parallel_scan_merges_parts_in_order},
+        {"search pages match full results", test_search_pages_match_full_results},
+        {"search split matches single scan", test_search_split_matches_single_scan},
+        {"search job drops stale results", test_search_job_drops_stale_results},
+        {"thread pool runs nested groups", test_thread_pool_runs_nested_groups},
+        {"catalog serves readers during writes", test_catalog_serves_readers_during_writes},
+        {"sharded catalog touches one shard", test_sharded_catalog_touches_one_shard},
+        {"changing shard count migrates layout", test_shard_count_change_migrates_layout}
+    };
+
+    const size_t total_tests = sizeof(tests) / sizeof(tests[0]);
+    size_t passed_tests = 0;
+
+    printf("Running unit tests...\n\n");
+
+    // Every test gets a catalog of its own, so the one the menu shows is never touched
+    for (size_t i = 0; i < total_tests; i++) {
+        Catalog catalog;
+        catalog_init(&catalog);
+        catalog_configure(&catalog, TEST_PRODUCTS_FILE, 0);
+        int rc = tests[i].func(&catalog);
+        catalog_rollback(&catalog);
+        catalog_free(&catalog);
+        if (rc == 0) {
+            printf("\033[1;32m[PASS]\033[0m %s\n", tests[i].name);
+            passed_tests++;
+        } else {
+            printf("\033[31m[FAIL]\033[0m %s\n", tests[i].name);
+        }
+    }
+
+    if (restore_products_file(&file_backup, TEST_PRODUCTS_FILE) != 0) {
+        printf("Warning: Failed to restore %s.\n", TEST_PRODUCTS_FILE);
+    }
 
     printf("\nTest summary: %zu/%zu passed.\n", passed_tests, total_tests);
 
@@ -0,0 +1,739 @@
+#include "art.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compressed path bytes kept in the node; longer paths are checked against a leaf below
+#define ART_MAX_PREFIX 8
+
+enum {
+    ART_NODE4 = 1,
+    ART_NODE16,
+    ART_NODE48,
+    ART_NODE256
+};
+
+typedef struct {
+    unsigned char type;
+    unsigned short num_children;
+    size_t prefix_len;
+    unsigned char prefix[ART_MAX_PREFIX];
+} ArtNode;
+
+typedef struct {
+    ArtNode n;
+    unsigned char keys[4]; // sorted
+    void *children[4];
+} ArtNode4;
+
+typedef struct {
+    ArtNode n;
+    unsigned char keys[16]; // sorted
+    void *children[16];
+} ArtNode16;
+
+typedef struct {
+    ArtNode n;
+    unsigned char index[256]; // child slot + 1, 0 when the byte has no child
+    void *children[48];
+} ArtNode48;
+
+typedef struct {
+    ArtNode n;
+    void *children[256];
+} ArtNode256;
+
+// Keys are stored with their NUL, so no key is a prefix of another
+typedef struct {
+    int value;
+    size_t key_len;
+    char key[];
+} ArtLeaf;
+
+// Child pointers to leaves carry a tag in the low bit
+#define ART_IS_LEAF(p) (((uintptr_t)(p)) & 1)
+#define ART_LEAF(p) ((ArtLeaf *)((uintptr_t)(p) & ~(uintptr_t)1))
+#define ART_TAG_LEAF(l) ((void *)((uintptr_t)(l) | 1))
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+static ArtLeaf *make_leaf(const unsigned char *key, size_t key_len, int value) {
+    ArtLeaf *leaf = (ArtLeaf *)malloc(sizeof(ArtLeaf) + key_len);
+    if (!leaf) {
+        return NULL;
+    }
+    leaf->value = value;
+    leaf->key_len = key_len;
+    memcpy(leaf->key, key, key_len);
+    return leaf;
+}
+
+static int leaf_matches(const ArtLeaf *leaf, const unsigned char *key, size_t key_len) {
+    return leaf->key_len == key_len && memcmp(leaf->key, key, key_len) == 0;
+}
+
+static ArtNode *alloc_node(unsigned char type) {
+    size_t size = type == ART_NODE4 ? sizeof(ArtNode4)
+                : type == ART_NODE16 ? sizeof(ArtNode16)
+                : type == ART_NODE48 ? sizeof(ArtNode48)
+                : sizeof(ArtNode256);
+    ArtNode *node = (ArtNode *)calloc(1, size);
+    if (node) {
+        node->type = type;
+    }
+    return node;
+}
+
+static void copy_header(ArtNode *dst, const ArtNode *src) {
+    dst->num_children = src->num_children;
+    dst->prefix_len = src->prefix_len;
+    memcpy(dst->prefix, src->prefix, min_size(src->prefix_len, ART_MAX_PREFIX));
+}
+
+static void free_rec(void *n) {
+    if (!n) {
+        return;
+    }
+    if (ART_IS_LEAF(n)) {
+        free(ART_LEAF(n));
+        return;
+    }
+    ArtNode *node = (ArtNode *)n;
+    switch (node->type) {
+    case ART_NODE4:
+        for (int i = 0; i < node->num_children; i++) {
+            free_rec(((ArtNode4 *)node)->children[i]);
+        }
+        break;
+    case ART_NODE16:
+        for (int i = 0; i < node->num_children; i++) {
+            free_rec(((ArtNode16 *)node)->children[i]);
+        }
+        break;
+    case ART_NODE48:
+        for (int i = 0; i < 48; i++) {
+            free_rec(((ArtNode48 *)node)->children[i]);
+        }
+        break;
+    default:
+        for (int i = 0; i < 256; i++) {
+            free_rec(((ArtNode256 *)node)->children[i]);
+        }
+        break;
+    }
+    free(node);
+}
+
+void art_init(ArtTree *tree) {
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+void art_free(ArtTree *tree) {
+    free_rec(tree->root);
+    art_init(tree);
+}
+
+int art_size(const ArtTree *tree) {
+    return tree->size;
+}
+
+static void **find_child(ArtNode *node, unsigned char c) {
+    switch (node->type) {
+    case ART_NODE4: {
+        ArtNode4 *p = (ArtNode4 *)node;
+        for (int i = 0; i < node->num_children; i++) {
+            if (p->keys[i] == c) {
+                return &p->children[i];
+            }
+        }
+        break;
+    }
+    case ART_NODE16: {
+        ArtNode16 *p = (ArtNode16 *)node;
+        for (int i = 0; i < node->num_children; i++) {
+            if (p->keys[i] == c) {
+                return &p->children[i];
+            }
+        }
+        break;
+    }
+    case ART_NODE48: {
+        ArtNode48 *p = (ArtNode48 *)node;
+        if (p->index[c]) {
+            return &p->children[p->index[c] - 1];
+        }
+        break;
+    }
+    default: {
+        ArtNode256 *p = (ArtNode256 *)node;
+        if (p->children[c]) {
+            return &p->children[c];
+        }
+        break;
+    }
+    }
+    return NULL;
+}
+
+static ArtLeaf *minimum(const void *n) {
+    while (n && !ART_IS_LEAF(n)) {
+        const ArtNode *node = (const ArtNode *)n;
+        switch (node->type) {
+        case ART_NODE4:
+            n = ((const ArtNode4 *)node)->children[0];
+            break;
+        case ART_NODE16:
+            n = ((const ArtNode16 *)node)->children[0];
+            break;
+        case ART_NODE48: {
+            const ArtNode48 *p = (const ArtNode48 *)node;
+            int c = 0;
+            while (!p->index[c]) {
+                c++;
+            }
+            n = p->children[p->index[c] - 1];
+            break;
+        }
+        default: {
+            const ArtNode256 *p = (const ArtNode256 *)node;
+            int c = 0;
+            while (!p->children[c]) {
+                c++;
+            }
+            n = p->children[c];
+            break;
+        }
+        }
+    }
+    return n ? ART_LEAF(n) : NULL;
+}
+
+// Bytes of the stored (possibly truncated) prefix that match key at depth
+static size_t check_prefix(const ArtNode *node, const unsigned char *key, size_t key_len, size_t depth) {
+    size_t max = min_size(min_size(node->prefix_len, ART_MAX_PREFIX), key_len - depth);
+    size_t i = 0;
+    while (i < max && node->prefix[i] == key[depth + i]) {
+        i++;
+    }
+    return i;
+}
+
+// Length of the full compressed path that matches key at depth
+static size_t prefix_mismatch(const ArtNode *node, const unsigned char *key, size_t key_len, size_t depth) {
+    size_t i = check_prefix(node, key, key_len, depth);
+    if (i < ART_MAX_PREFIX || node->prefix_len <= ART_MAX_PREFIX) {
+        return i;
+    }
+    const ArtLeaf *leaf = minimum(node);
+    size_t max = min_size(leaf->key_len, key_len) - depth;
+    while (i < max && (unsigned char)leaf->key[depth + i] == key[depth + i]) {
+        i++;
+    }
+    return i;
+}
+
+static int add_child(ArtNode *node, void **ref, unsigned char c, void *child);
+
+static int add_child256(ArtNode256 *node, unsigned char c, void *child) {
+    node->children[c] = child;
+    node->n.num_children++;
+    return 0;
+}
+
+static int add_child48(ArtNode48 *node, void **ref, unsigned char c, void *child) {
+    if (node->n.num_children < 48) {
+        int slot = 0;
+        while (node->children[slot]) {
+            slot++;
+        }
+        node->children[slot] = child;
+        node->index[c] = (unsigned char)(slot + 1);
+        node->n.num_children++;
+        return 0;
+    }
+    ArtNode256 *grown = (ArtNode256 *)alloc_node(ART_NODE256);
+    if (!grown) {
+        return -1;
+    }
+    for (int i = 0; i < 256; i++) {
+        if (node->index[i]) {
+            grown->children[i] = node->children[node->index[i] - 1];
+        }
+    }
+    copy_header(&grown->n, &node->n);
+    *ref = grown;
+    free(node);
+    return add_child256(grown, c, child);
+}
+
+static int add_child16(ArtNode16 *node, void **ref, unsigned char c, void *child) {
+    if (node->n.num_children < 16) {
+        int i = 0;
+        while (i < node->n.num_children && node->keys[i] < c) {
+            i++;
+        }
+        memmove(node->keys + i + 1, node->keys + i, (size_t)(node->n.num_children - i));
+        memmove(node->children + i + 1, node->children + i, (size_t)(node->n.num_children - i) * sizeof(void *));
+        node->keys[i] = c;
+        node->children[i] = child;
+        node->n.num_children++;
+        return 0;
+    }
+    ArtNode48 *grown = (ArtNode48 *)alloc_node(ART_NODE48);
+    if (!grown) {
+        return -1;
+    }
+    for (int i = 0; i < 16; i++) {
+        grown->children[i] = node->children[i];
+        grown->index[node->keys[i]] = (unsigned char)(i + 1);
+    }
+    copy_header(&grown->n, &node->n);
+    *ref = grown;
+    free(node);
+    return add_child48(grown, ref, c, child);
+}
+
+static int add_child4(ArtNode4 *node, void **ref, unsigned char c, void *child) {
+    if (node->n.num_children < 4) {
+        int i = 0;
+        while (i < node->n.num_children && node->keys[i] < c) {
+            i++;
+        }
+        memmove(node->keys + i + 1, node->keys + i, (size_t)(node->n.num_children - i));
+        memmove(node->children + i + 1, node->children + i, (size_t)(node->n.num_children - i) * sizeof(void *));
+        node->keys[i] = c;
+        node->children[i] = child;
+        node->n.num_children++;
+        return 0;
+    }
+    ArtNode16 *grown = (ArtNode16 *)alloc_node(ART_NODE16);
+    if (!grown) {
+        return -1;
+    }
+    memcpy(grown->keys, node->keys, 4);
+    memcpy(grown->children, node->children, 4 * sizeof(void *));
+    copy_header(&grown->n, &node->n);
+    *ref = grown;
+    free(node);
+    return add_child16(grown, ref, c, child);
+}
+
+static int add_child(ArtNode *node, void **ref, unsigned char c, void *child) {
+    switch (node->type) {
+    case ART_NODE4:
+        return add_child4((ArtNode4 *)node, ref, c, child);
+    case ART_NODE16:
+        return add_child16((ArtNode16 *)node, ref, c, child);
+    case ART_NODE48:
+        return add_child48((ArtNode48 *)node, ref, c, child);
+    default:
+        return add_child256((ArtNode256 *)node, c, child);
+    }
+}
+
+static int insert_rec(void **ref, const unsigned char *key, size_t key_len, int value, size_t depth) {
+    void *n = *ref;
+    if (!n) {
+        ArtLeaf *leaf = make_leaf(key, key_len, value);
+        if (!leaf) {
+            return -1;
+        }
+        *ref = ART_TAG_LEAF(leaf);
+        return 0;
+    }
+
+    if (ART_IS_LEAF(n)) {
+        ArtLeaf *existing = ART_LEAF(n);
+        if (leaf_matches(existing, key, key_len)) {
+            return 1;
+        }
+        // Two keys meet here: a node4 holds their common bytes as its path
+        ArtNode4 *split = (ArtNode4 *)alloc_node(ART_NODE4);
+        ArtLeaf *leaf = make_leaf(key, key_len, value);
+        if (!split || !leaf) {
+            free(split);
+            free(leaf);
+            return -1;
+        }
+        size_t common = 0;
+        size_t max = min_size(existing->key_len, key_len) - depth;
+        while (common < max && (unsigned char)existing->key[depth + common] == key[depth + common]) {
+            common++;
+        }
+        split->n.prefix_len = common;
+        memcpy(split->n.prefix, key + depth, min_size(common, ART_MAX_PREFIX));
+        add_child4(split, ref, (unsigned char)existing->key[depth + common], n);
+        add_child4(split, ref, key[depth + common], ART_TAG_LEAF(leaf));
+        *ref = split;
+        return 0;
+    }
+
+    ArtNode *node = (ArtNode *)n;
+    if (node->prefix_len) {
+        size_t diff = prefix_mismatch(node, key, key_len, depth);
+        if (diff < node->prefix_len) {
+            // The key leaves the compressed path: split it at diff
+            ArtNode4 *split = (ArtNode4 *)alloc_node(ART_NODE4);
+            ArtLeaf *leaf = make_leaf(key, key_len, value);
+            if (!split || !leaf) {
+                free(split);
+                free(leaf);
+                return -1;
+            }
+            split->n.prefix_len = diff;
+            memcpy(split->n.prefix, node->prefix, min_size(diff, ART_MAX_PREFIX));
+            if (node->prefix_len <= ART_MAX_PREFIX) {
+                add_child4(split, ref, node->prefix[diff], node);
+                node->prefix_len -= diff + 1;
+                memmove(node->prefix, node->prefix + diff + 1, min_size(node->prefix_len, ART_MAX_PREFIX));
+            } else {
+                node->prefix_len -= diff + 1;
+                const ArtLeaf *below = minimum(node);
+                add_child4(split, ref, (unsigned char)below->key[depth + diff], node);
+                memcpy(node->prefix, below->key + depth + diff + 1, min_size(node->prefix_len, ART_MAX_PREFIX));
+            }
+            add_child4(split, ref, key[depth + diff], ART_TAG_LEAF(leaf));
+            *ref = split;
+            return 0;
+        }
+        depth += node->prefix_len;
+    }
+
+    void **child = find_child(node, key[depth]);
+    if (child) {
+        return insert_rec(child, key, key_len, value, depth + 1);
+    }
+    ArtLeaf *leaf = make_leaf(key, key_len, value);
+    if (!leaf) {
+        return -1;
+    }
+    if (add_child(node, ref, key[depth], ART_TAG_LEAF(leaf)) != 0) {
+        free(leaf);
+        return -1;
+    }
+    return 0;
+}
+
+int art_insert(ArtTree *tree, const char *key, int value) {
+    int rc = insert_rec(&tree->root, (const unsigned char *)key, strlen(key) + 1, value, 0);
+    if (rc == 0) {
+        tree->size++;
+    }
+    return rc;
+}
+
+int art_search(const ArtTree *tree, const char *key) {
+    const unsigned char *k = (const unsigned char *)key;
+    size_t key_len = strlen(key) + 1;
+    size_t depth = 0;
+    void *n = tree->root;
+    while (n) {
+        if (ART_IS_LEAF(n)) {
+            const ArtLeaf *leaf = ART_LEAF(n);
+            return leaf_matches(leaf, k, key_len) ? leaf->value : -1;
+        }
+        ArtNode *node = (ArtNode *)n;
+        if (node->prefix_len) {
+            // Optimistic: skipped bytes past the stored prefix are verified at the leaf
+            if (check_prefix(node, k, key_len, depth) != min_size(node->prefix_len, ART_MAX_PREFIX)) {
+                return -1;
+            }
+            depth += node->prefix_len;
+        }
+        if (depth >= key_len) {
+            return -1;
+        }
+        void **child = find_child(node, k[depth]);
+        n = child ? *child : NULL;
+        depth++;
+    }
+    return -1;
+}
+
+static void remove_child(ArtNode *node, void **ref, unsigned char c, void **slot) {
+    switch (node->type) {
+    case ART_NODE4: {
+        ArtNode4 *p = (ArtNode4 *)node;
+        int i = (int)(slot - p->children);
+        memmove(p->keys + i, p->keys + i + 1, (size_t)(node->num_children - i - 1));
+        memmove(p->children + i, p->children + i + 1, (size_t)(node->num_children - i - 1) * sizeof(void *));
+        node->num_children--;
+        if (node->num_children == 1) {
+            // A single child absorbs this node's path and its key byte
+            void *child = p->children[0];
+            if (!ART_IS_LEAF(child)) {
+                ArtNode *below = (ArtNode *)child;
+                size_t len = node->prefix_len;
+                if (len < ART_MAX_PREFIX) {
+                    node->prefix[len++] = p->keys[0];
+                }
+                if (len < ART_MAX_PREFIX) {
+                    size_t extra = min_size(below->prefix_len, ART_MAX_PREFIX - len);
+                    memcpy(node->prefix + len, below->prefix, extra);
+                    len += extra;
+                }
+                memcpy(below->prefix, node->prefix, min_size(len, ART_MAX_PREFIX));
+                below->prefix_len += node->prefix_len + 1;
+            }
+            *ref = child;
+            free(node);
+        }
+        break;
+    }
+    case ART_NODE16: {
+        ArtNode16 *p = (ArtNode16 *)node;
+        int i = (int)(slot - p->children);
+        memmove(p->keys + i, p->keys + i + 1, (size_t)(node->num_children - i - 1));
+        memmove(p->children + i, p->children + i + 1, (size_t)(node->num_children - i - 1) * sizeof(void *));
+        node->num_children--;
+        if (node->num_children == 3) {
+            ArtNode4 *shrunk = (ArtNode4 *)alloc_node(ART_NODE4);
+            if (shrunk) {
+                copy_header(&shrunk->n, node);
+                memcpy(shrunk->keys, p->keys, 3);
+                memcpy(shrunk->children, p->children, 3 * sizeof(void *));
+                *ref = shrunk;
+                free(node);
+            }
+        }
+        break;
+    }
+    case ART_NODE48: {
+        ArtNode48 *p = (ArtNode48 *)node;
+        p->children[p->index[c] - 1] = NULL;
+        p->index[c] = 0;
+        node->num_children--;
+        if (node->num_children == 12) {
+            ArtNode16 *shrunk = (ArtNode16 *)alloc_node(ART_NODE16);
+            if (shrunk) {
+                copy_header(&shrunk->n, node);
+                int count = 0;
+                for (int i = 0; i < 256; i++) {
+                    if (p->index[i]) {
+                        shrunk->keys[count] = (unsigned char)i;
+                        shrunk->children[count++] = p->children[p->index[i] - 1];
+                    }
+                }
+                *ref = shrunk;
+                free(node);
+            }
+        }
+        break;
+    }
+    default: {
+        ArtNode256 *p = (ArtNode256 *)node;
+        p->children[c] = NULL;
+        node->num_children--;
+        if (node->num_children == 37) {
+            ArtNode48 *shrunk = (ArtNode48 *)alloc_node(ART_NODE48);
+            if (shrunk) {
+                copy_header(&shrunk->n, node);
+                int count = 0;
+                for (int i = 0; i < 256; i++) {
+                    if (p->children[i]) {
+                        shrunk->children[count] = p->children[i];
+                        shrunk->index[i] = (unsigned char)(++count);
+                    }
+                }
+                *ref = shrunk;
+                free(node);
+            }
+        }
+        break;
+    }
+    }
+}
+
+static ArtLeaf *delete_rec(void **ref, const unsigned char *key, size_t key_len, size_t depth) {
+    void *n = *ref;
+    if (!n) {
+        return NULL;
+    }
+    if (ART_IS_LEAF(n)) {
+        ArtLeaf *leaf = ART_LEAF(n);
+        if (!leaf_matches(leaf, key, key_len)) {
+            return NULL;
+        }
+        *ref = NULL;
+        return leaf;
+    }
+    ArtNode *node = (ArtNode *)n;
+    if (node->prefix_len) {
+        if (check_prefix(node, key, key_len, depth) != min_size(node->prefix_len, ART_MAX_PREFIX)) {
+            return NULL;
+        }
+        depth += node->prefix_len;
+    }
+    if (depth >= key_len) {
+        return NULL;
+    }
+    void **child = find_child(node, key[depth]);
+    if (!child) {
+        return NULL;
+    }
+    if (ART_IS_LEAF(*child)) {
+        ArtLeaf *leaf = ART_LEAF(*child);
+        if (!leaf_matches(leaf, key, key_len)) {
+            return NULL;
+        }
+        remove_child(node, ref, key[depth], child);
+        return leaf;
+    }
+    return delete_rec(child, key, key_len, depth + 1);
+}
+
+int art_delete(ArtTree *tree, const char *key) {
+    ArtLeaf *leaf = delete_rec(&tree->root, (const unsigned char *)key, strlen(key) + 1, 0);
+    if (!leaf) {
+        return -1;
+    }
+    int value = leaf->value;
+    free(leaf);
+    tree->size--;
+    return value;
+}
+
+static int iterate_rec(const void *n, ArtVisitor visit, void *ctx) {
+    if (!n) {
+        return 0;
+    }
+    if (ART_IS_LEAF(n)) {
+        const ArtLeaf *leaf = ART_LEAF(n);
+        return visit(leaf->key, leaf->value, ctx);
+    }
+    const ArtNode *node = (const ArtNode *)n;
+    int rc = 0;
+    switch (node->type) {
+    case ART_NODE4:
+        for (int i = 0; i < node->num_children && rc == 0; i++) {
+            rc = iterate_rec(((const ArtNode4 *)node)->children[i], visit, ctx);
+        }
+        break;
+    case ART_NODE16:
+        for (int i = 0; i < node->num_children && rc == 0; i++) {
+            rc = iterate_rec(((const ArtNode16 *)node)->children[i], visit, ctx);
+        }
+        break;
+    case ART_NODE48: {
+        const ArtNode48 *p = (const ArtNode48 *)node;
+        for (int i = 0; i < 256 && rc == 0; i++) {
+            if (p->index[i]) {
+                rc = iterate_rec(p->children[p->index[i] - 1], visit, ctx);
+            }
+        }
+        break;
+    }
+    default:
+        for (int i = 0; i < 256 && rc == 0; i++) {
+            rc = iterate_rec(((const ArtNode256 *)node)->children[i], visit, ctx);
+        }
+        break;
+    }
+    return rc;
+}
+
+int art_iterate(const ArtTree *tree, ArtVisitor visit, void *ctx) {
+    return iterate_rec(tree->root, visit, ctx);
+}
+
+static int byte_matches(unsigned char b, unsigned char want, int fold_case) {
+    return fold_case ? tolower(b) == tolower(want) : b == want;
+}
+
+static int prefix_rec(void *n, const unsigned char *prefix, size_t prefix_len, int fold_case, size_t depth,
+                      ArtVisitor visit, void *ctx) {
+    if (!n) {
+        return 0;
+    }
+    if (ART_IS_LEAF(n)) {
+        const ArtLeaf *leaf = ART_LEAF(n);
+        if (leaf->key_len <= prefix_len) {
+            return 0;
+        }
+        for (size_t i = 0; i < prefix_len; i++) {
+            if (!byte_matches((unsigned char)leaf->key[i], prefix[i], fold_case)) {
+                return 0;
+            }
+        }
+        return visit(leaf->key, leaf->value, ctx);
+    }
+
+    ArtNode *node = (ArtNode *)n;
+    if (node->prefix_len) {
+        // Path bytes past the stored prefix are read from any leaf below
+        const ArtLeaf *below = node->prefix_len > ART_MAX_PREFIX ? minimum(node) : NULL;
+        for (size_t i = 0; i < node->prefix_len && depth + i < prefix_len; i++) {
+            unsigned char b = i < ART_MAX_PREFIX ? node->prefix[i] : (unsigned char)below->key[depth + i];
+            if (!byte_matches(b, prefix[depth + i], fold_case)) {
+                return 0;
+            }
+        }
+        depth += node->prefix_len;
+    }
+    if (depth >= prefix_len) {
+        return iterate_rec(node, visit, ctx);
+    }
+
+    unsigned char c = prefix[depth];
+    if (fold_case && isalpha(c)) {
+        // Upper case sorts first, keeping the walk in key order
+        void **child = find_child(node, (unsigned char)toupper(c));
+        int rc = child ? prefix_rec(*child, prefix, prefix_len, fold_case, depth + 1, visit, ctx) : 0;
+        if (rc != 0) {
+            return rc;
+        }
+        child = find_child(node, (unsigned char)tolower(c));
+        return child ? prefix_rec(*child, prefix, prefix_len, fold_case, depth + 1, visit, ctx) : 0;
+    }
+    void **child = find_child(node, c);
+    return child ? prefix_rec(*child, prefix, prefix_len, fold_case, depth + 1, visit, ctx) : 0;
+}
+
+int art_iterate_prefix(const ArtTree *tree, const char *prefix, int fold_case, ArtVisitor visit, void *ctx) {
+    return prefix_rec(tree->root, (const unsigned char *)prefix, strlen(prefix), fold_case, 0, visit, ctx);
+}
+
+static void shift_rec(void *n, int from, int delta) {
+    if (!n) {
+        return;
+    }
+    if (ART_IS_LEAF(n)) {
+        ArtLeaf *leaf = ART_LEAF(n);
+        if (leaf->value >= from) {
+            leaf->value += delta;
+        }
+        return;
+    }
+    ArtNode *node = (ArtNode *)n;
+    switch (node->type) {
+    case ART_NODE4:
+        for (int i = 0; i < node->num_children; i++) {
+            shift_rec(((ArtNode4 *)node)->children[i], from, delta);
+        }
+        break;
+    case ART_NODE16:
+        for (int i = 0; i < node->num_children; i++) {
+            shift_rec(((ArtNode16 *)node)->children[i], from, delta);
+        }
+        break;
+    case ART_NODE48:
+        for (int i = 0; i < 48; i++) {
+            shift_rec(((ArtNode48 *)node)->children[i], from, delta);
+        }
+        break;
+    default:
+        for (int i = 0; i < 256; i++) {
+            shift_rec(((ArtNode256 *)node)->children[i], from, delta);
+        }
+        break;
+    }
+}
+
+void art_shift_values(ArtTree *tree, int from, int delta) {
+    shift_rec(tree->root, from, delta);
+}
@@ -0,0 +1,36 @@
+#ifndef ART_H
+#define ART_H
+
+// Adaptive radix tree mapping NUL-terminated string keys to int values.
+// Inner nodes grow from 4 to 16, 48 and 256 children as they fill and shrink back
+// when they empty, and single-child paths are compressed into the node below, so a
+// lookup costs O(key length) whatever the number of keys. Keys iterate in byte
+// (strcmp) order, and a prefix selects one subtree.
+
+typedef struct {
+    void *root;
+    int size;
+} ArtTree;
+
+// Visitor for iteration; a non-zero return stops the walk and is passed back
+typedef int (*ArtVisitor)(const char *key, int value, void *ctx);
+
+void art_init(ArtTree *tree);
+void art_free(ArtTree *tree);
+int art_size(const ArtTree *tree);
+
+// 0 when inserted, 1 when key was already present (its value is kept), -1 out of memory
+int art_insert(ArtTree *tree, const char *key, int value);
+// Value stored for key, or -1
+int art_search(const ArtTree *tree, const char *key);
+// Remove key and return its value, or -1 when it was not there
+int art_delete(ArtTree *tree, const char *key);
+
+int art_iterate(const ArtTree *tree, ArtVisitor visit, void *ctx);
+// Keys starting with prefix; with fold_case, ASCII letters of prefix match either case
+int art_iterate_prefix(const ArtTree *tree, const char *prefix, int fold_case, ArtVisitor visit, void *ctx);
+
+// Add delta to every value >= from (values mirror row numbers of an array that shifted)
+void art_shift_values(ArtTree *tree, int from, int delta);
+
+#endif // ART_H
@@ -0,0 +1,184 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "art.h"
+#include "file_watch.h"
+#include "ostree.h"
+#include "rwlock.h"
+
+// A product catalog: its rows, the indexes over them, the file(s) it persists to and its
+// transaction state. Every catalog function takes the handle it works on, so several
+// catalogs can be open at once, each with its own lock. Initialise with catalog_init and
+// release with catalog_free. Implemented in main.c.
+
+#define PRODUCTS_FILE "products.csv"
+#define MAX_CATALOG_SHARDS 64
+#define MAX_OPEN_CATALOGS 16
+
+typedef struct {
+    char ProductID[20];
+    char ProductName[100];
+    int Quantity;
+    int UnitPrice;
+} Product;
+
+// Orders offered by the product list; SORT_BY_ROW is the catalog's own (insertion) order.
+// SORT_BY_RELEVANCE ranks the matches of the current filter and has no index of its own.
+typedef enum {
+    SORT_BY_ROW = 0,
+    SORT_BY_ID,
+    SORT_BY_NAME,
+    SORT_BY_QUANTITY,
+    SORT_BY_PRICE,
+    SORT_BY_RELEVANCE,
+    SORT_KEY_COUNT
+} SortKey;
+
+#define SORT_INDEX_COUNT SORT_BY_RELEVANCE // keys below this are backed by a sort index
+
+// Result codes returned by catalog_commit()
+typedef enum {
+    CATALOG_COMMIT_OK = 0,
+    CATALOG_COMMIT_INVALID,
+    CATALOG_COMMIT_SAVE_FAILED
+} CatalogCommitResult;
+
+typedef enum {
+    CATALOG_OP_ADD = 0,
+    CATALOG_OP_UPDATE,
+    CATALOG_OP_REMOVE
+} CatalogOpType;
+
+// A buffered mutation; for updates a NULL name or negative number keeps the current value
+typedef struct {
+    CatalogOpType type;
+    Product data;
+    int has_name;
+} CatalogOp;
+
+typedef struct {
+    Product *products;
+    int product_count;
+    int product_capacity;
+
+    // Where commits persist: a single CSV, or shard_count files chosen by ProductID hash
+    char path[512];
+    int shard_count;
+    // Watch on path while a menu shows the catalog; our own saves are synced into it
+    FileWatch *watch;
+
+    // Bumped on every in-memory change so cached search results know they are stale
+    unsigned long version;
+
+    // Guards the rows and every index. Commits, loads, reloads and index builds take it for
+    // writing; searches and saves share it for reading, so they run side by side and only
+    // pause while a batch is applied. Pool tasks never take it (their spawner holds it).
+    // The menu's thread is the catalog's only writer and reads it unlocked.
+    RwLock lock;
+
+    // One order-statistic tree per sort key, node i standing for products[i]. Built on
+    // first use, then kept in step by txn_apply/txn_undo; bulk loads and reloads drop them.
+    OSTree sort_indexes[SORT_INDEX_COUNT];
+    int sort_indexes_ready;
+
+    // Adaptive radix tree from ProductID to row: ID lookups, prefix filters and ID-ordered
+    // saves. Built on first use and kept in step like the sort indexes.
+    ArtTree id_index;
+    int id_index_ready;
+    int id_index_duplicates; // rows repeating an earlier row's ID; only the first is indexed
+
+    // One transaction is open at a time: catalog_begin takes txn_lock and the commit or
+    // rollback releases it, so other threads' writes wait for the batch instead of joining it
+    pthread_mutex_t txn_lock;
+    pthread_t txn_owner;     // valid while txn_active
+    int txn_active;          // read atomically
+    CatalogOp *txn_ops;
+    int txn_op_count;
+    int txn_op_capacity;
+    int txn_failed_op;       // op rejected by the last CATALOG_COMMIT_INVALID, else -1
+} Catalog;
+
+// Empty catalog persisting to PRODUCTS_FILE
+void catalog_init(Catalog *catalog);
+void catalog_free(Catalog *catalog);
+// Choose where the catalog persists: path, or shard_count files derived from it
+int catalog_configure(Catalog *catalog, const char *path, int shard_count);
+// Load the configured file or shards
+int load_catalog(Catalog *catalog);
+// Load several catalogs in parallel
+int load_catalogs(Catalog **catalogs, int catalog_count);
+// Load from the binary snapshot next to a single CSV when it is current, else load and
+// write the snapshot; meant for one-shot read-only runs
+int load_catalog_cached(Catalog *catalog);
+
+int load_csv(Catalog *catalog, const char *filename);
+int save_csv(Catalog *catalog, const char *filename);
+int reload_csv_incremental(Catalog *catalog, const char *filename, int *out_added, int *out_updated, int *out_removed);
+int ensure_csv_exists(const char *filename);
+
+int add_product(Catalog *catalog, const char *ProductID, const char *ProductName, int Quantity, int UnitPrice);
+int update_product(Catalog *catalog, const char *ProductID, const char *ProductName, int Quantity, int UnitPrice);
+int remove_product(Catalog *catalog, const char *ProductID);
+
+int catalog_begin(Catalog *catalog);
+int catalog_commit(Catalog *catalog);
+int catalog_rollback(Catalog *catalog);
+
+// Apply a file of add/update/set-qty/remove commands as one transaction, saving once
+int exec_command_file(Catalog *catalog, const char *path);
+
+// Drop the indexes after the rows were changed behind the catalog's back
+void catalog_indexes_invalidate(Catalog *catalog);
+int catalog_sorted_row(Catalog *catalog, int sort_key, int descending, int rank);
+
+int find_products_by_keyword(Catalog *catalog, const char *keyword, int **out_matches);
+int find_products_ranked(Catalog *catalog, const char *keyword, int offset, int limit, int *out_rows);
+int find_products_by_query(Catalog *catalog, const char *query, int sort_key, int descending, int **out_matches);
+int find_products_in_range(Catalog *catalog, int sort_key, int low, int high, int **out_matches);
+
+// The matches of a query kept as their count plus a checkpoint every few hundred matches;
+// rows are produced a page at a time. Build and page while holding the catalog's read lock.
+typedef struct SearchResult SearchResult;
+
+SearchResult *search_result_create(void);
+void search_result_destroy(SearchResult *result);
+// result must be empty; cancel, when given, is polled. Returns the count, -1 on failure, or
+// a negative value other than -1 when cancelled.
+int search_result_build(Catalog *catalog, SearchResult *result, const char *query, int sort_key, int descending, const int *cancel);
+// Rows of matches [offset, offset + limit); returns how many were written
+int search_result_page(Catalog *catalog, SearchResult *result, int offset, int limit, int *out_rows);
+// Slices the last build scanned in parallel; 0 when no row had to be checked
+int search_result_parts(const SearchResult *result);
+
+// A search on a worker thread, as the menu runs for large catalogs. Starting one cancels
+// the search before it; collect hands over the result once it has finished.
+typedef struct SearchJob SearchJob;
+
+SearchJob *search_job_create(void);
+void search_job_destroy(SearchJob *job);
+int search_job_start(SearchJob *job, Catalog *catalog, const char *query, int sort_key, int descending);
+void search_job_cancel(SearchJob *job);
+// 1 with the result moved into out_result (which must be empty), 0 while still running
+int search_job_collect(SearchJob *job, SearchResult *out_result, int *out_status);
+
+// A match of a search across several catalogs: row of catalogs[catalog]
+typedef struct {
+    int catalog;
+    int row;
+} CatalogRow;
+
+int find_products_across(Catalog **catalogs, int catalog_count, const char *query, int sort_key, int descending, CatalogRow **out_rows);
+
+typedef enum {
+    OUTPUT_FORMAT_CSV = 0,
+    OUTPUT_FORMAT_TSV,
+    OUTPUT_FORMAT_JSON
+} OutputFormat;
+
+// Print the matches of a filter query, as --query does; returns the count or -1
+int write_query_results(Catalog **catalogs, int catalog_count, const char *query, OutputFormat format, FILE *out);
+
+#endif // CATALOG_H
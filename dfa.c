@@ -0,0 +1,529 @@
+#include "dfa.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NFA_MAX_STATES 1024
+
+enum {
+    NFA_SET,   // consume one byte of set, then out
+    NFA_SPLIT, // out and out1 without consuming
+    NFA_EPS,   // out without consuming
+    NFA_MATCH
+};
+
+typedef struct {
+    unsigned char kind;
+    unsigned char set[32];
+    int out;
+    int out1;
+} NfaState;
+
+typedef struct {
+    NfaState *states;
+    int count;
+    int capacity;
+    const char *p;    // parse position
+    int error;
+} Nfa;
+
+// A piece of automaton entered at start and left through end, an NFA_EPS still to be linked
+typedef struct {
+    int start;
+    int end;
+} Frag;
+
+static int nfa_state(Nfa *nfa, unsigned char kind, int out, int out1) {
+    if (nfa->error) {
+        return 0;
+    }
+    if (nfa->count == nfa->capacity) {
+        int capacity = nfa->capacity ? nfa->capacity * 2 : 64;
+        NfaState *grown = capacity > NFA_MAX_STATES ? NULL
+                        : (NfaState *)realloc(nfa->states, sizeof(NfaState) * (size_t)capacity);
+        if (!grown) {
+            nfa->error = 1;
+            return 0;
+        }
+        nfa->states = grown;
+        nfa->capacity = capacity;
+    }
+    NfaState *state = &nfa->states[nfa->count];
+    memset(state, 0, sizeof(*state));
+    state->kind = kind;
+    state->out = out;
+    state->out1 = out1;
+    return nfa->count++;
+}
+
+static void set_add(unsigned char *set, int c) {
+    set[c >> 3] |= (unsigned char)(1u << (c & 7));
+}
+
+static int set_has(const unsigned char *set, int c) {
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+static void set_add_folded(unsigned char *set, int c) {
+    set_add(set, c);
+    set_add(set, tolower(c));
+    set_add(set, toupper(c));
+}
+
+static void set_invert(unsigned char *set) {
+    for (int i = 0; i < 32; i++) {
+        set[i] = (unsigned char)~set[i];
+    }
+}
+
+static Frag frag_set(Nfa *nfa, const unsigned char *set) {
+    Frag frag;
+    frag.end = nfa_state(nfa, NFA_EPS, -1, -1);
+    frag.start = nfa_state(nfa, NFA_SET, frag.end, -1);
+    if (!nfa->error) {
+        memcpy(nfa->states[frag.start].set, set, 32);
+    }
+    return frag;
+}
+
+static Frag frag_empty(Nfa *nfa) {
+    Frag frag;
+    frag.start = frag.end = nfa_state(nfa, NFA_EPS, -1, -1);
+    return frag;
+}
+
+static void frag_link(Nfa *nfa, Frag from, int to) {
+    if (!nfa->error) {
+        nfa->states[from.end].out = to;
+    }
+}
+
+static Frag frag_concat(Nfa *nfa, Frag a, Frag b) {
+    frag_link(nfa, a, b.start);
+    Frag frag = {a.start, b.end};
+    return frag;
+}
+
+static Frag frag_alternate(Nfa *nfa, Frag a, Frag b) {
+    Frag frag;
+    frag.end = nfa_state(nfa, NFA_EPS, -1, -1);
+    frag.start = nfa_state(nfa, NFA_SPLIT, a.start, b.start);
+    frag_link(nfa, a, frag.end);
+    frag_link(nfa, b, frag.end);
+    return frag;
+}
+
+// op is '*', '+' or '?'
+static Frag frag_repeat(Nfa *nfa, Frag a, char op) {
+    Frag frag;
+    frag.end = nfa_state(nfa, NFA_EPS, -1, -1);
+    int split = nfa_state(nfa, NFA_SPLIT, a.start, frag.end);
+    frag_link(nfa, a, op == '?' ? frag.end : split);
+    frag.start = op == '+' ? a.start : split;
+    return frag;
+}
+
+static Frag frag_any_run(Nfa *nfa) {
+    unsigned char any[32];
+    memset(any, 0xFF, sizeof(any));
+    return frag_repeat(nfa, frag_set(nfa, any), '*');
+}
+
+// Class escape (\d \w \s and negations) into set; returns 0 when c is not one
+static int escape_class(unsigned char *set, char c) {
+    int lower = tolower((unsigned char)c);
+    if (lower != 'd' && lower != 'w' && lower != 's') {
+        return 0;
+    }
+    unsigned char members[32] = {0};
+    for (int b = 0; b < 128; b++) {
+        if ((lower == 'd' && isdigit(b)) || (lower == 'w' && (isalnum(b) || b == '_')) ||
+            (lower == 's' && isspace(b))) {
+            set_add(members, b);
+        }
+    }
+    if (isupper((unsigned char)c)) {
+        set_invert(members);
+    }
+    for (int i = 0; i < 32; i++) {
+        set[i] |= members[i];
+    }
+    return 1;
+}
+
+// Bracket expression after its '['; a leading ^ (or ! in a glob) negates it
+static Frag parse_class(Nfa *nfa, int glob) {
+    unsigned char set[32] = {0};
+    int negate = *nfa->p == '^' || (glob && *nfa->p == '!');
+    if (negate) {
+        nfa->p++;
+    }
+    int first = 1;
+    while (*nfa->p && (*nfa->p != ']' || first)) {
+        first = 0;
+        int c = (unsigned char)*nfa->p++;
+        if (c == '\\' && !glob && *nfa->p) {
+            if (escape_class(set, *nfa->p)) {
+                nfa->p++;
+                continue;
+            }
+            c = (unsigned char)*nfa->p++;
+        }
+        if (nfa->p[0] == '-' && nfa->p[1] && nfa->p[1] != ']') {
+            int last = (unsigned char)nfa->p[1];
+            nfa->p += 2;
+            for (int b = c; b <= last; b++) {
+                set_add_folded(set, b);
+            }
+        } else {
+            set_add_folded(set, c);
+        }
+    }
+    if (*nfa->p != ']') {
+        nfa->error = 1;
+        return frag_empty(nfa);
+    }
+    nfa->p++;
+    if (negate) {
+        set_invert(set); // members were added in both cases, so [^a] also excludes A
+    }
+    return frag_set(nfa, set);
+}
+
+static Frag parse_alternation(Nfa *nfa);
+
+static Frag parse_atom(Nfa *nfa) {
+    unsigned char set[32] = {0};
+    char c = *nfa->p++;
+    switch (c) {
+    case '(': {
+        Frag inner = parse_alternation(nfa);
+        if (*nfa->p != ')') {
+            nfa->error = 1;
+        } else {
+            nfa->p++;
+        }
+        return inner;
+    }
+    case '[':
+        return parse_class(nfa, 0);
+    case '.':
+        memset(set, 0xFF, sizeof(set));
+        return frag_set(nfa, set);
+    case '\\':
+        if (*nfa->p == '\0') {
+            nfa->error = 1;
+            return frag_empty(nfa);
+        }
+        c = *nfa->p++;
+        if (escape_class(set, c)) {
+            return frag_set(nfa, set);
+        }
+        break;
+    case '*':
+    case '+':
+    case '?':
+        nfa->error = 1; // nothing to repeat
+        return frag_empty(nfa);
+    default:
+        break;
+    }
+    set_add_folded(set, (unsigned char)c);
+    return frag_set(nfa, set);
+}
+
+static Frag parse_concatenation(Nfa *nfa) {
+    Frag frag = frag_empty(nfa);
+    while (*nfa->p && *nfa->p != '|' && *nfa->p != ')' && !nfa->error) {
+        Frag atom = parse_atom(nfa);
+        while (*nfa->p == '*' || *nfa->p == '+' || *nfa->p == '?') {
+            atom = frag_repeat(nfa, atom, *nfa->p++);
+        }
+        frag = frag_concat(nfa, frag, atom);
+    }
+    return frag;
+}
+
+static Frag parse_alternation(Nfa *nfa) {
+    Frag frag = parse_concatenation(nfa);
+    while (*nfa->p == '|' && !nfa->error) {
+        nfa->p++;
+        frag = frag_alternate(nfa, frag, parse_concatenation(nfa));
+    }
+    return frag;
+}
+
+static Frag parse_glob(Nfa *nfa) {
+    Frag frag = frag_empty(nfa);
+    while (*nfa->p && !nfa->error) {
+        unsigned char set[32] = {0};
+        char c = *nfa->p++;
+        Frag item;
+        if (c == '*') {
+            item = frag_any_run(nfa);
+        } else if (c == '?') {
+            memset(set, 0xFF, sizeof(set));
+            item = frag_set(nfa, set);
+        } else if (c == '[') {
+            item = parse_class(nfa, 1);
+        } else {
+            set_add_folded(set, (unsigned char)c);
+            item = frag_set(nfa, set);
+        }
+        frag = frag_concat(nfa, frag, item);
+    }
+    return frag;
+}
+
+// Subset construction. A DFA state is the epsilon closure of a set of NFA states, kept as a
+// bitset; states are numbered in discovery order, so the start closure is state 0.
+typedef struct {
+    const Nfa *nfa;
+    int words;
+    uint64_t *sets;    // DFA_MAX_STATES bitsets of words each
+    unsigned *hashes;
+    int *stack;
+} Subsets;
+
+static void closure(const Subsets *s, uint64_t *set) {
+    int depth = 0;
+    for (int i = 0; i < s->nfa->count; i++) {
+        if ((set[i >> 6] >> (i & 63)) & 1) {
+            s->stack[depth++] = i;
+        }
+    }
+    while (depth > 0) {
+        const NfaState *state = &s->nfa->states[s->stack[--depth]];
+        int outs[2] = {-1, -1};
+        if (state->kind == NFA_EPS) {
+            outs[0] = state->out;
+        } else if (state->kind == NFA_SPLIT) {
+            outs[0] = state->out;
+            outs[1] = state->out1;
+        }
+        for (int k = 0; k < 2; k++) {
+            int to = outs[k];
+            if (to >= 0 && !((set[to >> 6] >> (to & 63)) & 1)) {
+                set[to >> 6] |= (uint64_t)1 << (to & 63);
+                s->stack[depth++] = to;
+            }
+        }
+    }
+}
+
+static unsigned set_hash(const uint64_t *set, int words) {
+    uint64_t h = 1469598103934665603ull;
+    for (int i = 0; i < words; i++) {
+        h = (h ^ set[i]) * 1099511628211ull;
+    }
+    return (unsigned)(h ^ (h >> 32));
+}
+
+static int set_empty(const uint64_t *set, int words) {
+    for (int i = 0; i < words; i++) {
+        if (set[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Split bytes into classes no NFA_SET tells apart
+static void byte_classes(Dfa *dfa, const Nfa *nfa) {
+    memset(dfa->byte_class, 0, sizeof(dfa->byte_class));
+    dfa->class_count = 1;
+    int remap[512];
+    for (int i = 0; i < nfa->count; i++) {
+        if (nfa->states[i].kind != NFA_SET) {
+            continue;
+        }
+        for (int k = 0; k < 2 * dfa->class_count; k++) {
+            remap[k] = -1;
+        }
+        int count = 0;
+        for (int b = 0; b < 256; b++) {
+            int key = dfa->byte_class[b] * 2 + set_has(nfa->states[i].set, b);
+            if (remap[key] < 0) {
+                remap[key] = count++;
+            }
+            dfa->byte_class[b] = (unsigned char)remap[key];
+        }
+        dfa->class_count = count;
+    }
+}
+
+static int build_dfa(Dfa *dfa, Nfa *nfa, int start, int match) {
+    byte_classes(dfa, nfa);
+    unsigned char representative[256];
+    for (int b = 255; b >= 0; b--) {
+        representative[dfa->byte_class[b]] = (unsigned char)b;
+    }
+
+    Subsets s;
+    s.nfa = nfa;
+    s.words = (nfa->count + 63) / 64;
+    s.sets = (uint64_t *)calloc((size_t)DFA_MAX_STATES * (size_t)s.words, sizeof(uint64_t));
+    s.hashes = (unsigned *)malloc(sizeof(unsigned) * DFA_MAX_STATES);
+    s.stack = (int *)malloc(sizeof(int) * (size_t)nfa->count);
+    uint64_t *moved = (uint64_t *)malloc(sizeof(uint64_t) * (size_t)s.words);
+    dfa->next = (int *)malloc(sizeof(int) * (size_t)DFA_MAX_STATES * (size_t)dfa->class_count);
+    dfa->accept = (unsigned char *)calloc(DFA_MAX_STATES, 1);
+    int rc = 1;
+    if (!s.sets || !s.hashes || !s.stack || !moved || !dfa->next || !dfa->accept) {
+        goto done;
+    }
+
+    s.sets[start >> 6] |= (uint64_t)1 << (start & 63);
+    closure(&s, s.sets);
+    s.hashes[0] = set_hash(s.sets, s.words);
+    dfa->state_count = 1;
+    for (int d = 0; d < dfa->state_count; d++) {
+        const uint64_t *current = s.sets + (size_t)d * (size_t)s.words;
+        dfa->accept[d] = (unsigned char)((current[match >> 6] >> (match & 63)) & 1);
+        for (int c = 0; c < dfa->class_count; c++) {
+            memset(moved, 0, sizeof(uint64_t) * (size_t)s.words);
+            for (int i = 0; i < nfa->count; i++) {
+                const NfaState *state = &nfa->states[i];
+                if (state->kind == NFA_SET && ((current[i >> 6] >> (i & 63)) & 1) &&
+                    set_has(state->set, representative[c])) {
+                    moved[state->out >> 6] |= (uint64_t)1 << (state->out & 63);
+                }
+            }
+            closure(&s, moved);
+            int target = -1;
+            if (!set_empty(moved, s.words)) {
+                unsigned hash = set_hash(moved, s.words);
+                for (int k = 0; k < dfa->state_count && target < 0; k++) {
+                    if (s.hashes[k] == hash &&
+                        memcmp(s.sets + (size_t)k * (size_t)s.words, moved, sizeof(uint64_t) * (size_t)s.words) == 0) {
+                        target = k;
+                    }
+                }
+                if (target < 0) {
+                    if (dfa->state_count == DFA_MAX_STATES) {
+                        goto done;
+                    }
+                    target = dfa->state_count++;
+                    memcpy(s.sets + (size_t)target * (size_t)s.words, moved, sizeof(uint64_t) * (size_t)s.words);
+                    s.hashes[target] = hash;
+                }
+            }
+            dfa->next[d * dfa->class_count + c] = target;
+        }
+    }
+    rc = 0;
+
+done:
+    free(s.sets);
+    free(s.hashes);
+    free(s.stack);
+    free(moved);
+    return rc;
+}
+
+static int compile(Dfa *dfa, const char *pattern, int glob) {
+    memset(dfa, 0, sizeof(*dfa));
+    Nfa nfa;
+    memset(&nfa, 0, sizeof(nfa));
+
+    size_t length = strlen(pattern);
+    int anchored_start = glob;
+    dfa->anchored_end = glob;
+    char body[DFA_LITERAL_MAX * 4];
+    if (length >= sizeof(body)) {
+        return 1;
+    }
+    memcpy(body, pattern, length + 1);
+    if (!glob) {
+        if (body[0] == '^') {
+            anchored_start = 1;
+            memmove(body, body + 1, length--);
+        }
+        // A trailing '$' anchors unless it is escaped
+        size_t slashes = 0;
+        while (slashes + 1 < length && body[length - 2 - slashes] == '\\') {
+            slashes++;
+        }
+        if (length > 0 && body[length - 1] == '$' && slashes % 2 == 0) {
+            dfa->anchored_end = 1;
+            body[--length] = '\0';
+        }
+    }
+
+    // Unanchored ends match anywhere: .*R.*
+    nfa.p = body;
+    Frag frag = glob ? parse_glob(&nfa) : parse_alternation(&nfa);
+    if (*nfa.p != '\0') {
+        nfa.error = 1; // unbalanced ')'
+    }
+    if (!anchored_start) {
+        frag = frag_concat(&nfa, frag_any_run(&nfa), frag);
+    }
+    if (!dfa->anchored_end) {
+        frag = frag_concat(&nfa, frag, frag_any_run(&nfa));
+    }
+    int match = nfa_state(&nfa, NFA_MATCH, -1, -1);
+    frag_link(&nfa, frag, match);
+
+    int rc = nfa.error || build_dfa(dfa, &nfa, frag.start, match) != 0;
+    free(nfa.states);
+    if (rc != 0) {
+        dfa_free(dfa);
+        return 1;
+    }
+
+    // Literal prefix of the pattern, lowercased, for a cheap substring prefilter
+    if (!glob && strchr(body, '|')) {
+        return 0; // alternatives share no required prefix
+    }
+    size_t used = 0;
+    for (const char *p = body; *p && used + 1 < DFA_LITERAL_MAX; p++) {
+        char c = *p;
+        if (!glob && c == '\\' && p[1] && !isalnum((unsigned char)p[1])) {
+            c = *++p; // escaped punctuation is literal
+        } else if (strchr(glob ? "*?[" : ".[]()|*+?\\", c)) {
+            break;
+        }
+        if (!glob && (p[1] == '*' || p[1] == '?')) {
+            break; // this character may be absent
+        }
+        dfa->literal[used++] = (char)tolower((unsigned char)c);
+    }
+    dfa->literal[used] = '\0';
+    return 0;
+}
+
+int dfa_compile_regex(Dfa *dfa, const char *pattern) {
+    return compile(dfa, pattern, 0);
+}
+
+int dfa_compile_glob(Dfa *dfa, const char *pattern) {
+    return compile(dfa, pattern, 1);
+}
+
+void dfa_free(Dfa *dfa) {
+    free(dfa->next);
+    free(dfa->accept);
+    dfa->next = NULL;
+    dfa->accept = NULL;
+    dfa->state_count = 0;
+}
+
+int dfa_matches(const Dfa *dfa, const char *text) {
+    if (!dfa->next) {
+        return 0;
+    }
+    int state = 0;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (dfa->accept[state] && !dfa->anchored_end) {
+            return 1; // the trailing .* keeps every later state accepting
+        }
+        state = dfa->next[state * dfa->class_count + dfa->byte_class[*p]];
+        if (state < 0) {
+            return 0;
+        }
+    }
+    return dfa->accept[state];
+}
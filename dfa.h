@@ -0,0 +1,33 @@
+#ifndef DFA_H
+#define DFA_H
+
+// Regular expressions and globs compiled to a deterministic automaton. The pattern becomes
+// a Thompson NFA, which subset construction turns into a DFA over byte classes (bytes no
+// pattern item tells apart share a column), so matching reads each byte of the text once and
+// never backtracks. ASCII letters match either case.
+//
+// Regex: literals, ., [a-z] and [^...] classes, \d \w \s (\D \W \S), ( ), |, *, + and ?.
+// It matches anywhere in the text unless anchored with a leading ^ or a trailing $.
+// Glob: * (any run), ? (one character) and [...] classes ([!...] negates) over the whole text.
+
+#define DFA_MAX_STATES 512  // patterns needing more states are rejected
+#define DFA_LITERAL_MAX 64
+
+typedef struct {
+    int state_count;                   // state 0 is the start
+    int class_count;
+    unsigned char byte_class[256];
+    int *next;                         // next[state * class_count + class], -1 once no match is possible
+    unsigned char *accept;
+    int anchored_end;                  // a match must run to the end of the text
+    char literal[DFA_LITERAL_MAX];     // lowercase text every match contains, "" when none is known
+} Dfa;
+
+// 0 on success; 1 on a syntax error, a pattern needing too many states or no memory
+int dfa_compile_regex(Dfa *dfa, const char *pattern);
+int dfa_compile_glob(Dfa *dfa, const char *pattern);
+void dfa_free(Dfa *dfa);
+
+int dfa_matches(const Dfa *dfa, const char *text);
+
+#endif // DFA_H
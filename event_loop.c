@@ -0,0 +1,709 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "event_loop.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#define EVENT_LOOP_MAX_FDS 16
+#define EVENT_LOOP_MAX_SIGNALS 8
+#define EVENT_LOOP_MAX_TIMERS 16
+
+typedef struct {
+    int fd;
+    EventCallback cb;
+    void *ctx;
+} LoopFd;
+
+typedef struct {
+    int signo;
+    EventCallback cb;
+    void *ctx;
+} LoopSignal;
+
+typedef struct {
+    int id;
+    long long deadline_ms;
+    int interval_ms;
+    int repeat;
+    EventCallback cb;
+    void *ctx;
+} LoopTimer;
+
+typedef struct LoopPost {
+    EventCallback cb;
+    void *ctx;
+    struct LoopPost *next;
+} LoopPost;
+
+typedef struct {
+    int initialized;
+    int redraw;
+    int interrupted;       // set by a callback to end the current wait early
+    LoopFd fds[EVENT_LOOP_MAX_FDS];
+    int fd_count;
+    LoopSignal signals[EVENT_LOOP_MAX_SIGNALS];
+    int signal_count;
+    LoopTimer timers[EVENT_LOOP_MAX_TIMERS];
+    int timer_count;
+    int next_timer_id;
+#ifdef __linux__
+    int epoll_fd;
+    int signal_fd;
+    int timer_fd;
+    int wake_fd;
+    int input_fd;          // descriptor currently registered for event_loop_wait_input
+    int input_pollable;    // 0 when epoll refused it (regular files are always readable)
+    sigset_t signal_mask;
+#elif !defined(_WIN32)
+    int wake_pipe[2];      // posts write 0, signal handlers write the signal number
+#endif
+} EventLoop;
+
+static EventLoop g_loop = {0};
+
+// Posts arrive from worker threads; everything else in g_loop belongs to the loop thread
+static pthread_mutex_t g_post_lock = PTHREAD_MUTEX_INITIALIZER;
+static LoopPost *g_post_head = NULL;
+static LoopPost *g_post_tail = NULL;
+
+static long long loop_now_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000L;
+#endif
+}
+
+long long event_loop_now_ms(void) {
+    return loop_now_ms();
+}
+
+#if !defined(_WIN32) && !defined(__linux__)
+static volatile int g_signal_pipe_fd = -1;
+
+static void loop_signal_handler(int signo) {
+    int saved = errno;
+    unsigned char byte = (unsigned char)signo;
+    if (g_signal_pipe_fd >= 0) {
+        ssize_t ignored = write(g_signal_pipe_fd, &byte, 1);
+        (void)ignored;
+    }
+    errno = saved;
+}
+
+static int loop_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        return 1;
+    }
+    return fcntl(fd, F_SETFD, FD_CLOEXEC) != 0;
+}
+#endif
+
+int event_loop_init(void) {
+    if (g_loop.initialized) {
+        return 0;
+    }
+
+    memset(&g_loop, 0, sizeof(g_loop));
+    g_loop.next_timer_id = 1;
+
+#ifdef __linux__
+    g_loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    g_loop.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_loop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    g_loop.signal_fd = -1;
+    g_loop.input_fd = -1;
+    sigemptyset(&g_loop.signal_mask);
+    if (g_loop.epoll_fd < 0 || g_loop.wake_fd < 0 || g_loop.timer_fd < 0) {
+        if (g_loop.epoll_fd >= 0) {
+            close(g_loop.epoll_fd);
+        }
+        if (g_loop.wake_fd >= 0) {
+            close(g_loop.wake_fd);
+        }
+        if (g_loop.timer_fd >= 0) {
+            close(g_loop.timer_fd);
+        }
+        return 1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = g_loop.wake_fd;
+    epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, g_loop.wake_fd, &ev);
+    ev.data.fd = g_loop.timer_fd;
+    epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, g_loop.timer_fd, &ev);
+#elif !defined(_WIN32)
+    if (pipe(g_loop.wake_pipe) != 0) {
+        return 1;
+    }
+    if (loop_set_nonblocking(g_loop.wake_pipe[0]) != 0 || loop_set_nonblocking(g_loop.wake_pipe[1]) != 0) {
+        close(g_loop.wake_pipe[0]);
+        close(g_loop.wake_pipe[1]);
+        return 1;
+    }
+    g_signal_pipe_fd = g_loop.wake_pipe[1];
+#endif
+
+    g_loop.initialized = 1;
+    return 0;
+}
+
+void event_loop_shutdown(void) {
+    if (!g_loop.initialized) {
+        return;
+    }
+
+#ifdef __linux__
+    close(g_loop.epoll_fd);
+    close(g_loop.wake_fd);
+    close(g_loop.timer_fd);
+    if (g_loop.signal_fd >= 0) {
+        close(g_loop.signal_fd);
+        pthread_sigmask(SIG_UNBLOCK, &g_loop.signal_mask, NULL);
+    }
+#elif !defined(_WIN32)
+    for (int i = 0; i < g_loop.signal_count; i++) {
+        signal(g_loop.signals[i].signo, SIG_DFL);
+    }
+    g_signal_pipe_fd = -1;
+    close(g_loop.wake_pipe[0]);
+    close(g_loop.wake_pipe[1]);
+#endif
+
+    pthread_mutex_lock(&g_post_lock);
+    while (g_post_head) {
+        LoopPost *next = g_post_head->next;
+        free(g_post_head);
+        g_post_head = next;
+    }
+    g_post_tail = NULL;
+    pthread_mutex_unlock(&g_post_lock);
+
+    memset(&g_loop, 0, sizeof(g_loop));
+}
+
+int event_loop_watch_fd(int fd, EventCallback cb, void *ctx) {
+    if (fd < 0 || !cb || event_loop_init() != 0) {
+        return 1;
+    }
+#ifdef _WIN32
+    (void)ctx;
+    return 1; // console input is the only descriptor the Windows loop can wait on
+#else
+    for (int i = 0; i < g_loop.fd_count; i++) {
+        if (g_loop.fds[i].fd == fd) {
+            g_loop.fds[i].cb = cb;
+            g_loop.fds[i].ctx = ctx;
+            return 0;
+        }
+    }
+    if (g_loop.fd_count >= EVENT_LOOP_MAX_FDS) {
+        return 1;
+    }
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        return 1;
+    }
+#endif
+    g_loop.fds[g_loop.fd_count].fd = fd;
+    g_loop.fds[g_loop.fd_count].cb = cb;
+    g_loop.fds[g_loop.fd_count].ctx = ctx;
+    g_loop.fd_count++;
+    return 0;
+#endif
+}
+
+void event_loop_unwatch_fd(int fd) {
+    if (!g_loop.initialized) {
+        return;
+    }
+    for (int i = 0; i < g_loop.fd_count; i++) {
+        if (g_loop.fds[i].fd == fd) {
+#ifdef __linux__
+            epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+            g_loop.fds[i] = g_loop.fds[g_loop.fd_count - 1];
+            g_loop.fd_count--;
+            return;
+        }
+    }
+}
+
+int event_loop_watch_signal(int signo, EventCallback cb, void *ctx) {
+    if (!cb || event_loop_init() != 0) {
+        return 1;
+    }
+#ifdef _WIN32
+    (void)signo;
+    (void)ctx;
+    return 1;
+#else
+    for (int i = 0; i < g_loop.signal_count; i++) {
+        if (g_loop.signals[i].signo == signo) {
+            g_loop.signals[i].cb = cb;
+            g_loop.signals[i].ctx = ctx;
+            return 0;
+        }
+    }
+    if (g_loop.signal_count >= EVENT_LOOP_MAX_SIGNALS) {
+        return 1;
+    }
+
+#ifdef __linux__
+    // signalfd only sees blocked signals; threads started later inherit the mask
+    sigaddset(&g_loop.signal_mask, signo);
+    if (pthread_sigmask(SIG_BLOCK, &g_loop.signal_mask, NULL) != 0) {
+        sigdelset(&g_loop.signal_mask, signo);
+        return 1;
+    }
+    int fd = signalfd(g_loop.signal_fd, &g_loop.signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        sigdelset(&g_loop.signal_mask, signo);
+        return 1;
+    }
+    if (g_loop.signal_fd < 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        g_loop.signal_fd = fd;
+    }
+#else
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = loop_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART; // the pipe wakes the loop; nothing else should see EINTR
+    if (sigaction(signo, &sa, NULL) != 0) {
+        return 1;
+    }
+#endif
+
+    g_loop.signals[g_loop.signal_count].signo = signo;
+    g_loop.signals[g_loop.signal_count].cb = cb;
+    g_loop.signals[g_loop.signal_count].ctx = ctx;
+    g_loop.signal_count++;
+    return 0;
+#endif
+}
+
+static long long loop_next_deadline(void) {
+    long long next = -1;
+    for (int i = 0; i < g_loop.timer_count; i++) {
+        if (next < 0 || g_loop.timers[i].deadline_ms < next) {
+            next = g_loop.timers[i].deadline_ms;
+        }
+    }
+    return next;
+}
+
+#ifdef __linux__
+// Keep the timerfd armed for the earliest pending deadline
+static void loop_arm_timerfd(void) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    long long next = loop_next_deadline();
+    if (next >= 0) {
+        if (next < 1) {
+            next = 1; // an all-zero it_value would disarm the timer
+        }
+        spec.it_value.tv_sec = (time_t)(next / 1000);
+        spec.it_value.tv_nsec = (long)(next % 1000) * 1000000L;
+    }
+    timerfd_settime(g_loop.timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+#endif
+
+int event_loop_add_timer(int interval_ms, int repeat, EventCallback cb, void *ctx) {
+    if (!cb || interval_ms < 0 || event_loop_init() != 0) {
+        return -1;
+    }
+    if (g_loop.timer_count >= EVENT_LOOP_MAX_TIMERS) {
+        return -1;
+    }
+    if (repeat && interval_ms == 0) {
+        interval_ms = 1;
+    }
+
+    LoopTimer *timer = &g_loop.timers[g_loop.timer_count++];
+    timer->id = g_loop.next_timer_id++;
+    timer->deadline_ms = loop_now_ms() + interval_ms;
+    timer->interval_ms = interval_ms;
+    timer->repeat = repeat;
+    timer->cb = cb;
+    timer->ctx = ctx;
+#ifdef __linux__
+    loop_arm_timerfd();
+#endif
+    return timer->id;
+}
+
+void event_loop_cancel_timer(int id) {
+    if (!g_loop.initialized) {
+        return;
+    }
+    for (int i = 0; i < g_loop.timer_count; i++) {
+        if (g_loop.timers[i].id == id) {
+            g_loop.timers[i] = g_loop.timers[g_loop.timer_count - 1];
+            g_loop.timer_count--;
+#ifdef __linux__
+            loop_arm_timerfd();
+#endif
+            return;
+        }
+    }
+}
+
+static void loop_wake(void) {
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t ignored = write(g_loop.wake_fd, &one, sizeof(one));
+    (void)ignored;
+#elif !defined(_WIN32)
+    unsigned char zero = 0;
+    ssize_t ignored = write(g_loop.wake_pipe[1], &zero, 1);
+    (void)ignored;
+#endif
+}
+
+int event_loop_post(EventCallback cb, void *ctx) {
+    if (!cb || !g_loop.initialized) {
+        return 1;
+    }
+    LoopPost *post = (LoopPost *)malloc(sizeof(LoopPost));
+    if (!post) {
+        return 1;
+    }
+    post->cb = cb;
+    post->ctx = ctx;
+    post->next = NULL;
+
+    pthread_mutex_lock(&g_post_lock);
+    if (g_post_tail) {
+        g_post_tail->next = post;
+    } else {
+        g_post_head = post;
+    }
+    g_post_tail = post;
+    loop_wake();
+    pthread_mutex_unlock(&g_post_lock);
+    return 0;
+}
+
+void event_loop_request_redraw(void) {
+    g_loop.redraw = 1;
+}
+
+static void loop_run_posts(void) {
+    pthread_mutex_lock(&g_post_lock);
+    LoopPost *post = g_post_head;
+    g_post_head = NULL;
+    g_post_tail = NULL;
+    pthread_mutex_unlock(&g_post_lock);
+
+    while (post) {
+        LoopPost *next = post->next;
+        post->cb(post->ctx);
+        free(post);
+        post = next;
+    }
+}
+
+// Fire due timers one at a time: a callback may add or cancel timers
+static void loop_run_timers(void) {
+    for (;;) {
+        long long now = loop_now_ms();
+        int due = -1;
+        for (int i = 0; i < g_loop.timer_count; i++) {
+            if (g_loop.timers[i].deadline_ms <= now) {
+                due = i;
+                break;
+            }
+        }
+        if (due < 0) {
+            break;
+        }
+
+        EventCallback cb = g_loop.timers[due].cb;
+        void *ctx = g_loop.timers[due].ctx;
+        if (g_loop.timers[due].repeat) {
+            g_loop.timers[due].deadline_ms = now + g_loop.timers[due].interval_ms;
+        } else {
+            g_loop.timers[due] = g_loop.timers[g_loop.timer_count - 1];
+            g_loop.timer_count--;
+        }
+        cb(ctx);
+    }
+#ifdef __linux__
+    loop_arm_timerfd();
+#endif
+}
+
+static void loop_run_signal(int signo) {
+    for (int i = 0; i < g_loop.signal_count; i++) {
+        if (g_loop.signals[i].signo == signo) {
+            g_loop.signals[i].cb(g_loop.signals[i].ctx);
+            return;
+        }
+    }
+}
+
+static void loop_run_fd(int fd) {
+    for (int i = 0; i < g_loop.fd_count; i++) {
+        if (g_loop.fds[i].fd == fd) {
+            g_loop.fds[i].cb(g_loop.fds[i].ctx);
+            return;
+        }
+    }
+}
+
+// Milliseconds the next wait may block: the caller's limit or the next timer, whichever is sooner
+static int loop_wait_budget(long long give_up_ms) {
+    long long now = loop_now_ms();
+    long long limit = give_up_ms;
+    long long next_timer = loop_next_deadline();
+    if (next_timer >= 0 && (limit < 0 || next_timer < limit)) {
+        limit = next_timer;
+    }
+    if (limit < 0) {
+        return -1;
+    }
+    if (limit <= now) {
+        return 0;
+    }
+    long long budget = limit - now;
+    return budget > 60000 ? 60000 : (int)budget;
+}
+
+#ifdef __linux__
+static int loop_register_input(int fd) {
+    if (fd == g_loop.input_fd) {
+        return g_loop.input_pollable;
+    }
+    if (g_loop.input_fd >= 0 && g_loop.input_pollable) {
+        epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_DEL, g_loop.input_fd, NULL);
+    }
+    g_loop.input_fd = fd;
+    g_loop.input_pollable = 0;
+    if (fd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        g_loop.input_pollable = epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+    return g_loop.input_pollable;
+}
+#endif
+
+int event_loop_wait_input(int fd, int timeout_ms) {
+    if (event_loop_init() != 0) {
+        return EVENT_LOOP_READY; // no loop: let the caller block in read()
+    }
+
+#ifdef __linux__
+    // Swap the registered input; fd -1 must not leave stdin in the set or it would spin
+    if (!loop_register_input(fd) && fd >= 0) {
+        return EVENT_LOOP_READY; // epoll rejects regular files, which never block
+    }
+#endif
+
+    long long give_up = timeout_ms >= 0 ? loop_now_ms() + timeout_ms : -1;
+
+    for (;;) {
+        loop_run_posts();
+        loop_run_timers();
+        if (g_loop.redraw) {
+            g_loop.redraw = 0;
+            return EVENT_LOOP_REDRAW;
+        }
+        if (g_loop.interrupted) {
+            g_loop.interrupted = 0;
+            return EVENT_LOOP_TIMEOUT;
+        }
+        int budget = loop_wait_budget(give_up);
+
+#ifdef _WIN32
+        if (fd >= 0 && _kbhit()) {
+            return EVENT_LOOP_READY;
+        }
+        Sleep((DWORD)(budget < 0 || budget > 10 ? 10 : budget));
+#elif defined(__linux__)
+        struct epoll_event events[EVENT_LOOP_MAX_FDS + 4];
+        int ready = epoll_wait(g_loop.epoll_fd, events, (int)(sizeof(events) / sizeof(events[0])), budget);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return EVENT_LOOP_READY;
+        }
+        int input_ready = 0;
+        for (int i = 0; i < ready; i++) {
+            int efd = events[i].data.fd;
+            if (efd == fd) {
+                input_ready = 1;
+            } else if (efd == g_loop.wake_fd) {
+                uint64_t count;
+                ssize_t ignored = read(g_loop.wake_fd, &count, sizeof(count));
+                (void)ignored;
+            } else if (efd == g_loop.timer_fd) {
+                uint64_t expirations;
+                ssize_t ignored = read(g_loop.timer_fd, &expirations, sizeof(expirations));
+                (void)ignored;
+            } else if (efd == g_loop.signal_fd) {
+                struct signalfd_siginfo info;
+                while (read(g_loop.signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+                    loop_run_signal((int)info.ssi_signo);
+                }
+            } else {
+                loop_run_fd(efd);
+            }
+        }
+        if (input_ready && !g_loop.redraw) {
+            return EVENT_LOOP_READY;
+        }
+#else
+        struct pollfd pfds[EVENT_LOOP_MAX_FDS + 2];
+        int count = 0;
+        pfds[count].fd = g_loop.wake_pipe[0];
+        pfds[count].events = POLLIN;
+        pfds[count].revents = 0;
+        count++;
+        int input_slot = -1;
+        if (fd >= 0) {
+            input_slot = count;
+            pfds[count].fd = fd;
+            pfds[count].events = POLLIN;
+            pfds[count].revents = 0;
+            count++;
+        }
+        int first_watched = count;
+        for (int i = 0; i < g_loop.fd_count; i++) {
+            pfds[count].fd = g_loop.fds[i].fd;
+            pfds[count].events = POLLIN;
+            pfds[count].revents = 0;
+            count++;
+        }
+
+        int ready = poll(pfds, (nfds_t)count, budget);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return EVENT_LOOP_READY;
+        }
+        if (pfds[0].revents & POLLIN) {
+            unsigned char bytes[64];
+            ssize_t got;
+            while ((got = read(g_loop.wake_pipe[0], bytes, sizeof(bytes))) > 0) {
+                for (ssize_t i = 0; i < got; i++) {
+                    if (bytes[i] != 0) {
+                        loop_run_signal((int)bytes[i]);
+                    }
+                }
+            }
+        }
+        for (int i = first_watched; i < count; i++) {
+            if (pfds[i].revents & (POLLIN | POLLHUP)) {
+                loop_run_fd(pfds[i].fd);
+            }
+        }
+        if (input_slot >= 0 && (pfds[input_slot].revents & (POLLIN | POLLHUP | POLLERR)) && !g_loop.redraw) {
+            return EVENT_LOOP_READY;
+        }
+#endif
+
+        // Checked after waiting so a zero timeout still polls the input once
+        if (give_up >= 0 && loop_now_ms() >= give_up) {
+            return EVENT_LOOP_TIMEOUT;
+        }
+    }
+}
+
+typedef struct {
+    EventCallback work;
+    void *work_ctx;
+    int done;
+} LoopTask;
+
+static void loop_task_finished(void *ctx) {
+    ((LoopTask *)ctx)->done = 1;
+    g_loop.interrupted = 1;
+}
+
+static void *loop_task_thread(void *arg) {
+    LoopTask *task = (LoopTask *)arg;
+    task->work(task->work_ctx);
+    event_loop_post(loop_task_finished, task);
+    return NULL;
+}
+
+int event_loop_run_task(EventCallback work, void *work_ctx, EventCallback tick, void *tick_ctx, int tick_ms) {
+    if (!work) {
+        return 1;
+    }
+
+    LoopTask task = {work, work_ctx, 0};
+    pthread_t thread;
+    if (event_loop_init() != 0 || pthread_create(&thread, NULL, loop_task_thread, &task) != 0) {
+        work(work_ctx); // no loop or no thread: the screen just waits
+        return 0;
+    }
+
+    int timer = (tick && tick_ms > 0) ? event_loop_add_timer(tick_ms, 1, tick, tick_ctx) : -1;
+    int redraw_requested = 0;
+    while (!task.done) {
+        // Only internal events: keystrokes stay queued for whoever reads next
+        if (event_loop_wait_input(-1, -1) == EVENT_LOOP_REDRAW) {
+            redraw_requested = 1;
+        }
+    }
+    if (timer > 0) {
+        event_loop_cancel_timer(timer);
+    }
+    pthread_join(thread, NULL);
+    if (redraw_requested) {
+        event_loop_request_redraw();
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// Single-threaded event loop owned by the UI thread.
+// Linux multiplexes stdin, watched descriptors, signals (signalfd), timers (timerfd)
+// and cross-thread wakeups (eventfd) through one epoll set; other POSIX systems use
+// poll with a self-pipe, and Windows polls the console between short sleeps.
+// Callbacks always run on the thread that calls event_loop_wait_input.
+
+typedef void (*EventCallback)(void *ctx);
+
+#define EVENT_LOOP_TIMEOUT 0
+#define EVENT_LOOP_READY 1
+#define EVENT_LOOP_REDRAW (-2) // a callback asked the UI to repaint before reading more input
+
+int event_loop_init(void);
+void event_loop_shutdown(void);
+
+// Run cb whenever fd becomes readable; one callback per descriptor
+int event_loop_watch_fd(int fd, EventCallback cb, void *ctx);
+void event_loop_unwatch_fd(int fd);
+
+// Deliver a signal to cb on the loop thread instead of interrupting whatever is running
+int event_loop_watch_signal(int signo, EventCallback cb, void *ctx);
+
+// Milliseconds on the monotonic clock the timers run on
+long long event_loop_now_ms(void);
+
+// Returns a timer id (> 0) or -1; interval_ms > 0 with repeat re-arms after each expiry
+int event_loop_add_timer(int interval_ms, int repeat, EventCallback cb, void *ctx);
+void event_loop_cancel_timer(int id);
+
+// Thread-safe: queue cb to run on the loop thread and wake it
+int event_loop_post(EventCallback cb, void *ctx);
+
+// Make the current or next wait return EVENT_LOOP_REDRAW
+void event_loop_request_redraw(void);
+
+// Dispatch events until fd is readable (EVENT_LOOP_READY), a redraw is requested
+// or timeout_ms elapses (-1 waits forever). Windows ignores fd and watches the console.
+int event_loop_wait_input(int fd, int timeout_ms);
+
+// Run work on a helper thread while the loop keeps dispatching; tick (may be NULL)
+// fires every tick_ms until the work finishes. Returns 0 once work has returned.
+int event_loop_run_task(EventCallback work, void *work_ctx, EventCallback tick, void *tick_ctx, int tick_ms);
+
+#endif // EVENT_LOOP_H
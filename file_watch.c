@@ -0,0 +1,163 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "file_watch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+static void file_watch_read_signature(const char *path, long long *mtime, long long *size) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        *mtime = (long long)st.st_mtime;
+        *size = (long long)st.st_size;
+    } else {
+        *mtime = -1;
+        *size = -1;
+    }
+}
+
+int file_watch_signature(const char *path, long long *mtime, long long *size) {
+    file_watch_read_signature(path, mtime, size);
+    return *mtime < 0 ? 1 : 0;
+}
+
+int file_watch_open(FileWatch *watch, const char *path) {
+    if (!watch || !path || strlen(path) >= sizeof(watch->path)) {
+        return 1;
+    }
+
+    memset(watch, 0, sizeof(*watch));
+    if (pthread_mutex_init(&watch->lock, NULL) != 0) {
+        return 1;
+    }
+    strcpy(watch->path, path);
+    watch->fd = -1;
+
+    const char *slash = strrchr(watch->path, '/');
+#ifdef _WIN32
+    const char *backslash = strrchr(watch->path, '\\');
+    if (backslash && (!slash || backslash > slash)) {
+        slash = backslash;
+    }
+#endif
+    watch->name = slash ? slash + 1 : watch->path;
+
+    file_watch_read_signature(watch->path, &watch->mtime, &watch->size);
+
+#ifdef __linux__
+    char dir[sizeof(watch->path)];
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == watch->path) {
+        strcpy(dir, "/");
+    } else {
+        size_t dir_len = (size_t)(slash - watch->path);
+        memcpy(dir, watch->path, dir_len);
+        dir[dir_len] = '\0';
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0) {
+        // Watch the directory: rename-on-save replaces the inode a file watch would hold
+        if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0) {
+            watch->fd = fd;
+        } else {
+            close(fd);
+        }
+    }
+#endif
+
+    return 0;
+}
+
+// Caller holds watch->lock
+static int file_watch_poll_locked(FileWatch *watch) {
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        int changed = 0;
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+        for (;;) {
+            ssize_t len = read(watch->fd, buf, sizeof(buf));
+            if (len <= 0) {
+                if (len < 0 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (char *p = buf; p < buf + len;) {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                if (ev->len > 0 && strcmp(ev->name, watch->name) == 0) {
+                    changed = 1;
+                }
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+
+        if (changed) {
+            file_watch_read_signature(watch->path, &watch->mtime, &watch->size);
+        }
+        return changed;
+    }
+#endif
+
+    long long mtime = 0;
+    long long size = 0;
+    file_watch_read_signature(watch->path, &mtime, &size);
+    if (mtime == watch->mtime && size == watch->size) {
+        return 0;
+    }
+    watch->mtime = mtime;
+    watch->size = size;
+    return 1;
+}
+
+// Returns 1 when the file changed since the last poll or sync, 0 otherwise
+int file_watch_poll(FileWatch *watch) {
+    if (!watch || watch->path[0] == '\0') {
+        return 0;
+    }
+    pthread_mutex_lock(&watch->lock);
+    int changed = file_watch_poll_locked(watch);
+    pthread_mutex_unlock(&watch->lock);
+    return changed;
+}
+
+// Forget pending changes, e.g. right after the program wrote the file itself
+void file_watch_sync(FileWatch *watch) {
+    if (!watch || watch->path[0] == '\0') {
+        return;
+    }
+    pthread_mutex_lock(&watch->lock);
+    file_watch_poll_locked(watch);
+    file_watch_read_signature(watch->path, &watch->mtime, &watch->size);
+    pthread_mutex_unlock(&watch->lock);
+}
+
+// Descriptor that becomes readable on change, or -1 when the watch has to be polled
+int file_watch_fd(const FileWatch *watch) {
+    return watch ? watch->fd : -1;
+}
+
+void file_watch_close(FileWatch *watch) {
+    if (!watch || watch->path[0] == '\0') {
+        return;
+    }
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+#endif
+    watch->fd = -1;
+    watch->path[0] = '\0';
+    pthread_mutex_destroy(&watch->lock);
+}
@@ -0,0 +1,28 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include <pthread.h>
+
+// Detects external modification of a single file.
+// Linux uses inotify on the parent directory so editors that save by rename are seen;
+// other platforms fall back to comparing the file's mtime and size on every poll.
+// Polls and syncs may come from different threads (the menu polls while saves sync).
+typedef struct {
+    char path[512];
+    const char *name;      // basename inside path
+    int fd;                // inotify descriptor, -1 when polling with stat
+    long long mtime;
+    long long size;
+    pthread_mutex_t lock;  // guards fd reads and the signature between open and close
+} FileWatch;
+
+int file_watch_open(FileWatch *watch, const char *path);
+int file_watch_poll(FileWatch *watch);
+void file_watch_sync(FileWatch *watch);
+int file_watch_fd(const FileWatch *watch);
+void file_watch_close(FileWatch *watch);
+
+// mtime (seconds) and size of path, as polling compares them; 1 if it cannot be stat'ed
+int file_watch_signature(const char *path, long long *mtime, long long *size);
+
+#endif // FILE_WATCH_H
@@ -0,0 +1,59 @@
+#include "fuzzy.h"
+
+#include <ctype.h>
+#include <string.h>
+
+int fuzzy_compile(FuzzyPattern *pattern, const char *text) {
+    size_t length = strlen(text);
+    if (length == 0 || length > FUZZY_MAX_PATTERN) {
+        return 1;
+    }
+    memset(pattern, 0, sizeof(*pattern));
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        pattern->peq[tolower(c)] |= (uint64_t)1 << i;
+        pattern->peq[toupper(c)] |= (uint64_t)1 << i;
+    }
+    pattern->last = (uint64_t)1 << (length - 1);
+    pattern->length = (int)length;
+    return 0;
+}
+
+// Column by column over text, the vertical deltas of the last dynamic-programming column
+// are kept as bit vectors (pv: +1, mv: -1) and score is the bottom cell, i.e. the distance of
+// the best match ending here. The top row stays 0 so a match may start anywhere.
+// Returns the smallest score seen, or the first one <= stop_at.
+static int fuzzy_scan(const FuzzyPattern *pattern, const char *text, int stop_at) {
+    uint64_t pv = ~(uint64_t)0;
+    uint64_t mv = 0;
+    int score = pattern->length;
+    int best = score;
+    for (const unsigned char *p = (const unsigned char *)text; *p && best > stop_at; p++) {
+        uint64_t eq = pattern->peq[*p];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & pattern->last) {
+            score++;
+        } else if (mh & pattern->last) {
+            score--;
+        }
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (score < best) {
+            best = score;
+        }
+    }
+    return best;
+}
+
+int fuzzy_contains(const FuzzyPattern *pattern, const char *text, int max_edits) {
+    return fuzzy_scan(pattern, text, max_edits) <= max_edits;
+}
+
+int fuzzy_distance(const FuzzyPattern *pattern, const char *text) {
+    return fuzzy_scan(pattern, text, 0);
+}
@@ -0,0 +1,27 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stdint.h>
+
+// Approximate substring matching with Myers' bit-vector algorithm: the edit distance
+// (insertions, deletions, substitutions) between a pattern and the best-matching substring
+// of a text, computed one text character at a time with a handful of word operations, so a
+// text of length n costs O(n) whatever the distance allowed. ASCII letters match either case.
+
+#define FUZZY_MAX_PATTERN 64 // one bit per pattern character
+
+typedef struct {
+    uint64_t peq[256]; // bit i set where pattern[i] equals the byte
+    uint64_t last;     // bit of the last pattern character
+    int length;
+} FuzzyPattern;
+
+// Returns 1 when text is empty or longer than FUZZY_MAX_PATTERN
+int fuzzy_compile(FuzzyPattern *pattern, const char *text);
+
+// Whether some substring of text is within max_edits of the pattern; stops at the first one
+int fuzzy_contains(const FuzzyPattern *pattern, const char *text, int max_edits);
+// Smallest edit distance between the pattern and any substring of text
+int fuzzy_distance(const FuzzyPattern *pattern, const char *text);
+
+#endif // FUZZY_H
@@ -1,4 +1,13 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "helpers.h"
+#include "event_loop.h"
+#include "screen.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -10,6 +19,8 @@
 #include <windows.h>
 #include <conio.h>
 #else
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/ioctl.h>
@@ -33,7 +44,157 @@ void helpers_set_hooks(const HelpersHooks *hooks) {
     }
 }
 
+// Cached terminal geometry
+static int g_terminal_rows = 24;
+static int g_terminal_cols = 80;
+
+#ifndef _WIN32
+// The terminal stays in raw mode for the whole session; termios is only touched on entry and exit
+typedef struct {
+    int active;
+    struct termios saved;
+} TerminalSession;
+
+static TerminalSession g_session = {0};
+
+// Keys are decoded from this buffer, refilled with read(2) on the stdin descriptor
+static unsigned char g_input_buf[512];
+static size_t g_input_len = 0;
+static size_t g_input_pos = 0;
+
+static const int g_session_signals[] = {SIGTERM, SIGHUP, SIGINT, SIGQUIT};
+
+// Terminal size is measured once and again only after SIGWINCH says it changed.
+// The signal is delivered through the event loop, which wakes any pending key read.
+static int g_winch_pending = 1;
+static int g_winch_installed = 0;
+static void terminal_winch_event(void *ctx) {
+    (void)ctx;
+    g_winch_pending = 1;
+    screen_invalidate();
+    event_loop_request_redraw();
+}
+
+static void terminal_geometry_install(void) {
+    if (g_winch_installed) {
+        return;
+    }
+    g_winch_installed = 1;
+    event_loop_watch_signal(SIGWINCH, terminal_winch_event, NULL);
+}
+
+static void terminal_session_signal_handler(int signo) {
+    if (g_session.active) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &g_session.saved);
+        g_session.active = 0;
+    }
+    signal(signo, SIG_DFL);
+    raise(signo);
+}
+
+#define INPUT_REDRAW EVENT_LOOP_REDRAW
+
+// Wait up to timeout_ms (-1 blocks) for more input while the event loop runs timers,
+// signals and posted work; returns 1 when bytes were buffered, 0 on end of input or
+// timeout, INPUT_REDRAW when a callback asked for a repaint first
+static int input_fill(int timeout_ms) {
+    if (g_input_pos < g_input_len) {
+        return 1;
+    }
+    g_input_pos = 0;
+    g_input_len = 0;
+
+    if (g_test_hooks.read_input) {
+        long got = g_test_hooks.read_input(g_input_buf, sizeof(g_input_buf), timeout_ms);
+        g_input_len = got > 0 ? (size_t)got : 0;
+        return got > 0 ? 1 : 0;
+    }
+
+    for (;;) {
+        int ready = event_loop_wait_input(STDIN_FILENO, timeout_ms);
+        if (ready == EVENT_LOOP_REDRAW) {
+            if (timeout_ms >= 0) {
+                // Short waits (escape sequences, typeahead) leave the repaint to the next blocking read
+                event_loop_request_redraw();
+                return 0;
+            }
+            return INPUT_REDRAW;
+        }
+        if (ready == EVENT_LOOP_TIMEOUT) {
+            return 0;
+        }
+
+        ssize_t got = read(STDIN_FILENO, g_input_buf, sizeof(g_input_buf));
+        if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        g_input_len = (size_t)got;
+        return 1;
+    }
+}
+
+// Next input byte, -1 on end of input / timeout, or INPUT_REDRAW
+static int input_getc(int timeout_ms) {
+    int rc = input_fill(timeout_ms);
+    if (rc != 1) {
+        return rc == INPUT_REDRAW ? INPUT_REDRAW : -1;
+    }
+    return g_input_buf[g_input_pos++];
+}
+#endif
+
+int terminal_session_begin(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    if (g_session.active) {
+        return 0;
+    }
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &g_session.saved) != 0) {
+        return 1;
+    }
+
+    struct termios raw = g_session.saved;
+    raw.c_lflag &= (tcflag_t)(~(ICANON | ECHO | ISIG | IEXTEN));
+    raw.c_iflag &= (tcflag_t)(~(IXON | ICRNL)); // Ctrl+Q/Ctrl+S reach us, Enter arrives as '\r'
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0) {
+        return 1;
+    }
+    g_session.active = 1;
+    terminal_geometry_install();
+
+    static int registered = 0;
+    if (!registered) {
+        registered = 1;
+        atexit(terminal_session_end);
+        for (size_t i = 0; i < sizeof(g_session_signals) / sizeof(g_session_signals[0]); i++) {
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = terminal_session_signal_handler;
+            sigemptyset(&sa.sa_mask);
+            sigaction(g_session_signals[i], &sa, NULL);
+        }
+    }
+    return 0;
+#endif
+}
+
+void terminal_session_end(void) {
+#ifndef _WIN32
+    if (g_session.active) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &g_session.saved);
+        g_session.active = 0;
+    }
+#endif
+}
+
 void clear_screen(void) {
+    screen_invalidate();
     if (g_test_hooks.clear_screen) {
         g_test_hooks.clear_screen();
         return;
@@ -41,14 +202,60 @@ void clear_screen(void) {
     printf("\033[2J\033[H");
 }
 
+// Cursor addressing only makes sense on a real terminal that is not driven by test hooks
+int terminal_is_interactive(void) {
+    if (g_test_hooks.write_output) {
+        return 1;
+    }
+    if (g_test_hooks.clear_screen) {
+        return 0;
+    }
+#ifdef _WIN32
+    DWORD mode = 0;
+    HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    return handle != INVALID_HANDLE_VALUE && GetConsoleMode(handle, &mode);
+#else
+    return isatty(STDOUT_FILENO);
+#endif
+}
+
+long terminal_write(const char *data, size_t len) {
+    if (g_test_hooks.write_output) {
+        return g_test_hooks.write_output(data, len);
+    }
+#ifdef _WIN32
+    size_t written = fwrite(data, 1, len, stdout);
+    fflush(stdout);
+    return written > 0 || len == 0 ? (long)written : -1;
+#else
+    return (long)write(STDOUT_FILENO, data, len);
+#endif
+}
+
 void wait_for_enter(void) {
+    screen_mark_below_dirty();
     if (g_test_hooks.wait_for_enter) {
         g_test_hooks.wait_for_enter();
         return;
     }
     printf("\033[1;32mPress Enter to back to menu...\033[0m");
     fflush(stdout);
+#ifdef _WIN32
     getchar();
+#else
+    for (;;) {
+        int ch = input_getc(-1);
+        if (ch == INPUT_REDRAW) {
+            continue;
+        }
+        if (ch < 0 || ch == '\n' || ch == '\r') {
+            break;
+        }
+    }
+    if (g_session.active) {
+        printf("\n");
+    }
+#endif
 }
 
 void trim_whitespace(char *str) {
@@ -76,30 +283,70 @@ int read_line_allow_ctrl(char *buffer, size_t size) {
         return 0;
     }
 
+    screen_mark_below_dirty();
     if (g_test_hooks.read_line_allow_ctrl) {
         return g_test_hooks.read_line_allow_ctrl(buffer, size);
     }
 
-#ifndef _WIN32
-    struct termios oldt;
-    int have_old = 0;
-    if (tcgetattr(STDIN_FILENO, &oldt) == 0) {
-        have_old = 1;
-        struct termios newt = oldt;
-        newt.c_lflag &= (tcflag_t)(~ISIG);
-        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+#ifdef _WIN32
+    return fgets(buffer, (int)size, stdin) != NULL;
+#else
+    // Raw mode: echo and erase ourselves; Ctrl+X / Ctrl+Z finish the line at once
+    size_t len = 0;
+    int echo = g_session.active;
+    for (;;) {
+        int ch = input_getc(-1);
+        if (ch == INPUT_REDRAW) {
+            continue;
+        }
+        if (ch < 0) {
+            if (len == 0) {
+                return 0;
+            }
+            break;
+        }
+        if (ch == '\r' || ch == '\n') {
+            break;
+        }
+        if (ch == 0x18 || ch == 0x1A) {
+            len = 0;
+            buffer[len++] = (char)ch;
+            break;
+        }
+        if (ch == 127 || ch == 8) {
+            if (len > 0) {
+                // Drop a whole UTF-8 sequence, not just its last byte
+                do {
+                    len--;
+                } while (len > 0 && ((unsigned char)buffer[len] & 0xC0) == 0x80);
+                if (echo) {
+                    fputs("\b \b", stdout);
+                    fflush(stdout);
+                }
+            }
+            continue;
+        }
+        if (ch < 0x20) {
+            continue;
+        }
+        if (len + 2 < size) {
+            buffer[len++] = (char)ch;
+            if (echo) {
+                fputc(ch, stdout);
+                fflush(stdout);
+            }
+        }
     }
-#endif
-
-    char *res = fgets(buffer, (int)size, stdin);
 
-#ifndef _WIN32
-    if (have_old) {
-        tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    if (echo) {
+        fputc('\n', stdout);
+    }
+    if (len + 1 < size) {
+        buffer[len++] = '\n';
     }
+    buffer[len] = '\0';
+    return 1;
 #endif
-
-    return res != NULL;
 }
 
 static int input_matches_ctrl(const char *input, unsigned char control_value, char letter) {
@@ -135,6 +382,17 @@ int input_is_ctrl_z(const char *input) {
     return input_matches_ctrl(input, 0x1A, 'Z');
 }
 
+int menu_key_available(void) {
+    if (g_test_hooks.read_menu_key) {
+        return 0; // scripted keys are consumed one per frame
+    }
+#ifdef _WIN32
+    return _kbhit() ? 1 : 0;
+#else
+    return input_fill(0) == 1;
+#endif
+}
+
 MenuKey read_menu_key(int *out_digit, char *out_char) {
     if (out_digit) {
         *out_digit = -1;
@@ -148,6 +406,9 @@ MenuKey read_menu_key(int *out_digit, char *out_char) {
     }
 
 #ifdef _WIN32
+    if (event_loop_wait_input(0, -1) == EVENT_LOOP_REDRAW) {
+        return MENU_KEY_REDRAW;
+    }
     int ch = _getch();
     if (ch == 0 || ch == 0xE0) {
         int ch2 = _getch();
@@ -172,6 +433,18 @@ MenuKey read_menu_key(int *out_digit, char *out_char) {
     if (ch == 0x0E) {
         return MENU_KEY_SHORTCUT_ADD_PRODUCT;
     }
+    if (ch == '\t') {
+        return MENU_KEY_SHORTCUT_CYCLE_SORT;
+    }
+    if (ch == 0x12) {
+        return MENU_KEY_SHORTCUT_REVERSE_SORT;
+    }
+    if (ch == 0x0C) {
+        return MENU_KEY_SHORTCUT_LOW_STOCK;
+    }
+    if (ch == 0x06) {
+        return MENU_KEY_SHORTCUT_FUZZY;
+    }
     if (ch == '\r') {
         return MENU_KEY_ENTER;
     }
@@ -195,124 +468,138 @@ MenuKey read_menu_key(int *out_digit, char *out_char) {
     }
     return MENU_KEY_NONE;
 #else
-    struct termios oldt;
-    if (tcgetattr(STDIN_FILENO, &oldt) != 0) {
-        return MENU_KEY_NONE;
+    int ch = input_getc(-1);
+    if (ch == INPUT_REDRAW) {
+        return MENU_KEY_REDRAW;
     }
-
-    struct termios newt = oldt;
-    newt.c_lflag &= (tcflag_t)(~(ICANON | ECHO | ISIG));
-    newt.c_cc[VMIN] = 1;
-    newt.c_cc[VTIME] = 0;
-
-    if (tcsetattr(STDIN_FILENO, TCSANOW, &newt) != 0) {
+    if (ch < 0) {
         return MENU_KEY_NONE;
     }
 
-    MenuKey result = MENU_KEY_NONE;
-    int ch = getchar();
-    if (ch == EOF) {
-        result = MENU_KEY_NONE;
-        goto restore_termios;
-    }
-
     unsigned char uch = (unsigned char)ch;
 
     if (ch == '\n' || ch == '\r') {
-        result = MENU_KEY_ENTER;
-        goto restore_termios;
+        return MENU_KEY_ENTER;
     }
 
     if (ch == 127 || ch == 8) {
-        result = MENU_KEY_BACKSPACE;
-        goto restore_termios;
+        return MENU_KEY_BACKSPACE;
     }
 
     if (ch == 0x14) {
-        result = MENU_KEY_SHORTCUT_RUN_TESTS;
-        goto restore_termios;
+        return MENU_KEY_SHORTCUT_RUN_TESTS;
     }
     if (ch == 0x05) {
-        result = MENU_KEY_SHORTCUT_RUN_E2E;
-        goto restore_termios;
+        return MENU_KEY_SHORTCUT_RUN_E2E;
     }
-    if (ch == 0x11) {
-        result = MENU_KEY_SHORTCUT_EXIT;
-        goto restore_termios;
+    if (ch == 0x11 || ch == 3) {
+        return MENU_KEY_SHORTCUT_EXIT;
     }
     if (ch == 0x0E) {
-        result = MENU_KEY_SHORTCUT_ADD_PRODUCT;
-        goto restore_termios;
+        return MENU_KEY_SHORTCUT_ADD_PRODUCT;
+    }
+    if (ch == '\t') {
+        return MENU_KEY_SHORTCUT_CYCLE_SORT;
+    }
+    if (ch == 0x12) {
+        return MENU_KEY_SHORTCUT_REVERSE_SORT;
+    }
+    if (ch == 0x0C) {
+        return MENU_KEY_SHORTCUT_LOW_STOCK;
+    }
+    if (ch == 0x06) {
+        return MENU_KEY_SHORTCUT_FUZZY;
     }
 
     if (uch >= '0' && uch <= '9') {
         if (out_digit) {
             *out_digit = (int)(uch - '0');
         }
-        result = MENU_KEY_DIGIT;
-        goto restore_termios;
+        return MENU_KEY_DIGIT;
     }
 
     if (uch == 27) {
-        int ch1 = getchar();
-        if (ch1 == '[') {
-            int ch2 = getchar();
-            if (ch2 == 'A') {
-                result = MENU_KEY_UP;
-            } else if (ch2 == 'B') {
-                result = MENU_KEY_DOWN;
+        // A lone Escape has nothing queued behind it within a few milliseconds
+        int ch1 = input_getc(30);
+        if (ch1 != '[' && ch1 != 'O') {
+            if (ch1 >= 0) {
+                g_input_pos--; // not a sequence: leave the byte for the next key
             }
-        } else if (ch1 == EOF) {
-            result = MENU_KEY_ESCAPE;
-        } else {
-            result = MENU_KEY_ESCAPE;
+            return MENU_KEY_ESCAPE;
+        }
+        int final = input_getc(30);
+        while (final >= 0 && !(final >= 0x40 && final <= 0x7E)) {
+            final = input_getc(30); // skip parameters of sequences such as ESC [ 3 ~
+        }
+        if (final == 'A') {
+            return MENU_KEY_UP;
         }
-        goto restore_termios;
+        if (final == 'B') {
+            return MENU_KEY_DOWN;
+        }
+        return MENU_KEY_NONE;
     }
 
     if (uch >= 0x20 && uch != 0x7F) {
         if (out_char) {
             *out_char = (char)uch;
         }
-        result = MENU_KEY_CHAR;
-        goto restore_termios;
-    }
-
-    if (ch == 3) {
-        result = MENU_KEY_SHORTCUT_EXIT;
-        goto restore_termios;
+        return MENU_KEY_CHAR;
     }
 
-restore_termios:
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    return result;
+    return MENU_KEY_NONE;
 #endif
 }
 
-int get_terminal_rows(void) {
+static int env_dimension(const char *name, int fallback) {
+    const char *value = getenv(name);
+    if (value) {
+        char *endptr = NULL;
+        long parsed = strtol(value, &endptr, 10);
+        if (endptr != value && parsed > 0 && parsed <= INT_MAX) {
+            return (int)parsed;
+        }
+    }
+    return fallback;
+}
+
+static void terminal_geometry_refresh(void) {
 #ifdef _WIN32
     CONSOLE_SCREEN_BUFFER_INFO info;
     HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
     if (handle != INVALID_HANDLE_VALUE && GetConsoleScreenBufferInfo(handle, &info)) {
         int rows = (int)(info.srWindow.Bottom - info.srWindow.Top + 1);
-        if (rows > 0) {
-            return rows;
-        }
+        int cols = (int)(info.srWindow.Right - info.srWindow.Left + 1);
+        g_terminal_rows = rows > 0 ? rows : 24;
+        g_terminal_cols = cols > 0 ? cols : 80;
+        return;
     }
+    g_terminal_rows = env_dimension("LINES", 24);
+    g_terminal_cols = env_dimension("COLUMNS", 80);
 #else
-    struct winsize ws;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0) {
-        return (int)ws.ws_row;
+    terminal_geometry_install();
+    if (!g_winch_pending) {
+        return;
     }
+    g_winch_pending = 0;
 
-    const char *env_rows = getenv("LINES");
-    if (env_rows) {
-        char *endptr = NULL;
-        long parsed = strtol(env_rows, &endptr, 10);
-        if (endptr != env_rows && parsed > 0 && parsed <= INT_MAX) {
-            return (int)parsed;
-        }
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0) {
+        g_terminal_rows = (int)ws.ws_row;
+        g_terminal_cols = ws.ws_col > 0 ? (int)ws.ws_col : 80;
+        return;
     }
+    g_terminal_rows = env_dimension("LINES", 24);
+    g_terminal_cols = env_dimension("COLUMNS", 80);
 #endif
-    return 24;
+}
+
+int get_terminal_rows(void) {
+    terminal_geometry_refresh();
+    return g_terminal_rows;
+}
+
+int get_terminal_cols(void) {
+    terminal_geometry_refresh();
+    return g_terminal_cols;
 }
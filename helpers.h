@@ -15,7 +15,12 @@ typedef enum {
     MENU_KEY_SHORTCUT_RUN_TESTS,
     MENU_KEY_SHORTCUT_RUN_E2E,
     MENU_KEY_SHORTCUT_EXIT,
-    MENU_KEY_SHORTCUT_ADD_PRODUCT
+    MENU_KEY_SHORTCUT_ADD_PRODUCT,
+    MENU_KEY_SHORTCUT_CYCLE_SORT,
+    MENU_KEY_SHORTCUT_REVERSE_SORT,
+    MENU_KEY_SHORTCUT_LOW_STOCK,
+    MENU_KEY_SHORTCUT_FUZZY,
+    MENU_KEY_REDRAW // terminal resized or background work finished: repaint before reading on
 } MenuKey;
 
 typedef struct {
@@ -23,6 +28,11 @@ typedef struct {
     int (*read_line_allow_ctrl)(char *buffer, size_t size);
     void (*wait_for_enter)(void);
     void (*clear_screen)(void);
+    // Receives frame output instead of stdout; frames are then diffed as on a real terminal
+    long (*write_output)(const char *data, size_t len);
+    // Supplies raw terminal input in place of stdin: bytes stored, or 0 when nothing arrived
+    // within timeout_ms (-1 waits) or input ended. Keys are then decoded as typed.
+    long (*read_input)(unsigned char *buffer, size_t size, int timeout_ms);
 } HelpersHooks;
 
 void clear_screen(void);
@@ -33,7 +43,15 @@ char lowercase_ascii_char(char c);
 int input_is_ctrl_x(const char *input);
 int input_is_ctrl_z(const char *input);
 MenuKey read_menu_key(int *out_digit, char *out_char);
+// 1 when another key is already waiting, so read_menu_key will not block
+int menu_key_available(void);
 int get_terminal_rows(void);
+int get_terminal_cols(void);
+int terminal_is_interactive(void);
+// Hand bytes to the terminal; returns how many were taken, or -1 with errno set
+long terminal_write(const char *data, size_t len);
+int terminal_session_begin(void);
+void terminal_session_end(void);
 void helpers_set_hooks(const HelpersHooks *hooks);
 
 #endif // HELPERS_H
@@ -0,0 +1,396 @@
+#include "ostree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OSTREE_NIL (-1)
+
+static int node_size(const OSTree *tree, int node) {
+    return node == OSTREE_NIL ? 0 : tree->nodes[node].size;
+}
+
+static void node_update(OSTree *tree, int node) {
+    OSTreeNode *n = &tree->nodes[node];
+    n->size = 1 + node_size(tree, n->left) + node_size(tree, n->right);
+}
+
+// Strict order used by the tree: the caller's key, then the item number
+static int item_less(const OSTree *tree, int a, int b) {
+    int c = tree->cmp(a, b, tree->ctx);
+    if (c != 0) {
+        return c < 0;
+    }
+    return a < b;
+}
+
+static unsigned next_priority(OSTree *tree) {
+    unsigned x = tree->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tree->seed = x;
+    return x;
+}
+
+void ostree_init(OSTree *tree, OSTreeCompare cmp, void *ctx) {
+    memset(tree, 0, sizeof(*tree));
+    tree->root = OSTREE_NIL;
+    tree->seed = 2463534242u;
+    tree->cmp = cmp;
+    tree->ctx = ctx;
+}
+
+void ostree_free(OSTree *tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->capacity = 0;
+    tree->root = OSTREE_NIL;
+    tree->count = 0;
+}
+
+int ostree_reserve(OSTree *tree, int capacity) {
+    if (capacity <= tree->capacity) {
+        return 0;
+    }
+    int new_capacity = tree->capacity == 0 ? 16 : tree->capacity;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    OSTreeNode *nodes = (OSTreeNode *)realloc(tree->nodes, (size_t)new_capacity * sizeof(OSTreeNode));
+    if (!nodes) {
+        return 1;
+    }
+    tree->nodes = nodes;
+    tree->capacity = new_capacity;
+    return 0;
+}
+
+// Higher priority stays on top
+static int treap_merge(OSTree *tree, int a, int b) {
+    if (a == OSTREE_NIL) {
+        return b;
+    }
+    if (b == OSTREE_NIL) {
+        return a;
+    }
+    if (tree->nodes[a].priority > tree->nodes[b].priority) {
+        tree->nodes[a].right = treap_merge(tree, tree->nodes[a].right, b);
+        node_update(tree, a);
+        return a;
+    }
+    tree->nodes[b].left = treap_merge(tree, a, tree->nodes[b].left);
+    node_update(tree, b);
+    return b;
+}
+
+// Split into items ordered before item and items ordered after it
+static void treap_split(OSTree *tree, int node, int item, int *out_left, int *out_right) {
+    if (node == OSTREE_NIL) {
+        *out_left = OSTREE_NIL;
+        *out_right = OSTREE_NIL;
+        return;
+    }
+    if (item_less(tree, node, item)) {
+        int right = OSTREE_NIL;
+        treap_split(tree, tree->nodes[node].right, item, &right, out_right);
+        tree->nodes[node].right = right;
+        *out_left = node;
+    } else {
+        int left = OSTREE_NIL;
+        treap_split(tree, tree->nodes[node].left, item, out_left, &left);
+        tree->nodes[node].left = left;
+        *out_right = node;
+    }
+    node_update(tree, node);
+}
+
+int ostree_insert(OSTree *tree, int item) {
+    if (item < 0 || ostree_reserve(tree, item + 1) != 0) {
+        return 1;
+    }
+    OSTreeNode *n = &tree->nodes[item];
+    n->left = OSTREE_NIL;
+    n->right = OSTREE_NIL;
+    n->size = 1;
+    n->priority = next_priority(tree);
+
+    int left = OSTREE_NIL;
+    int right = OSTREE_NIL;
+    treap_split(tree, tree->root, item, &left, &right);
+    tree->root = treap_merge(tree, treap_merge(tree, left, item), right);
+    tree->count++;
+    return 0;
+}
+
+static void merge_sort_items(const OSTree *tree, int *items, int *scratch, int count) {
+    for (int width = 1; width < count; width *= 2) {
+        for (int lo = 0; lo < count; lo += 2 * width) {
+            int mid = lo + width < count ? lo + width : count;
+            int hi = lo + 2 * width < count ? lo + 2 * width : count;
+            int a = lo;
+            int b = mid;
+            int out = lo;
+            while (a < mid && b < hi) {
+                scratch[out++] = item_less(tree, items[b], items[a]) ? items[b++] : items[a++];
+            }
+            while (a < mid) {
+                scratch[out++] = items[a++];
+            }
+            while (b < hi) {
+                scratch[out++] = items[b++];
+            }
+        }
+        memcpy(items, scratch, (size_t)count * sizeof(int));
+    }
+}
+
+static int fix_sizes(OSTree *tree, int node) {
+    if (node == OSTREE_NIL) {
+        return 0;
+    }
+    OSTreeNode *n = &tree->nodes[node];
+    n->size = 1 + fix_sizes(tree, n->left) + fix_sizes(tree, n->right);
+    return n->size;
+}
+
+// Sort once, then lay the sorted items out as a treap in one left-to-right pass
+// (Cartesian tree over random priorities): O(n log n) compares, no rebalancing
+int ostree_build(OSTree *tree, int count) {
+    if (count <= 0) {
+        return 0;
+    }
+    if (ostree_reserve(tree, count) != 0) {
+        return 1;
+    }
+    int *items = (int *)malloc((size_t)count * sizeof(int));
+    int *stack = (int *)malloc((size_t)count * sizeof(int));
+    if (!items || !stack) {
+        free(items);
+        free(stack);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        items[i] = i;
+    }
+    merge_sort_items(tree, items, stack, count);
+
+    int depth = 0;
+    for (int i = 0; i < count; i++) {
+        int item = items[i];
+        OSTreeNode *n = &tree->nodes[item];
+        n->priority = next_priority(tree);
+        n->right = OSTREE_NIL;
+        int last = OSTREE_NIL;
+        while (depth > 0 && tree->nodes[stack[depth - 1]].priority < n->priority) {
+            last = stack[--depth];
+        }
+        n->left = last;
+        if (depth > 0) {
+            tree->nodes[stack[depth - 1]].right = item;
+        }
+        stack[depth++] = item;
+    }
+    tree->root = stack[0];
+    tree->count = count;
+    fix_sizes(tree, tree->root);
+
+    free(items);
+    free(stack);
+    return 0;
+}
+
+static int treap_erase(OSTree *tree, int node, int item, int *found) {
+    if (node == OSTREE_NIL) {
+        return OSTREE_NIL;
+    }
+    OSTreeNode *n = &tree->nodes[node];
+    if (node == item) {
+        *found = 1;
+        return treap_merge(tree, n->left, n->right);
+    }
+    if (item_less(tree, item, node)) {
+        int left = treap_erase(tree, n->left, item, found);
+        tree->nodes[node].left = left;
+    } else {
+        int right = treap_erase(tree, n->right, item, found);
+        tree->nodes[node].right = right;
+    }
+    node_update(tree, node);
+    return node;
+}
+
+void ostree_erase(OSTree *tree, int item) {
+    int found = 0;
+    tree->root = treap_erase(tree, tree->root, item, &found);
+    if (found) {
+        tree->count--;
+    }
+}
+
+static int shift_link(int link, int item, int delta) {
+    if (link == OSTREE_NIL) {
+        return link;
+    }
+    return (delta < 0 ? link > item : link >= item) ? link + delta : link;
+}
+
+void ostree_remove_slot(OSTree *tree, int item) {
+    int slots = tree->count + 1; // item was erased already
+    for (int i = 0; i < slots; i++) {
+        if (i == item) {
+            continue;
+        }
+        tree->nodes[i].left = shift_link(tree->nodes[i].left, item, -1);
+        tree->nodes[i].right = shift_link(tree->nodes[i].right, item, -1);
+    }
+    memmove(&tree->nodes[item], &tree->nodes[item + 1], (size_t)(slots - item - 1) * sizeof(OSTreeNode));
+    tree->root = shift_link(tree->root, item, -1);
+}
+
+int ostree_insert_slot(OSTree *tree, int item) {
+    int slots = tree->count;
+    if (ostree_reserve(tree, slots + 1) != 0) {
+        return 1;
+    }
+    memmove(&tree->nodes[item + 1], &tree->nodes[item], (size_t)(slots - item) * sizeof(OSTreeNode));
+    for (int i = 0; i <= slots; i++) {
+        if (i == item) {
+            continue;
+        }
+        tree->nodes[i].left = shift_link(tree->nodes[i].left, item, 1);
+        tree->nodes[i].right = shift_link(tree->nodes[i].right, item, 1);
+    }
+    tree->root = shift_link(tree->root, item, 1);
+    return 0;
+}
+
+int ostree_size(const OSTree *tree) {
+    return tree->count;
+}
+
+int ostree_select(const OSTree *tree, int rank) {
+    if (rank < 0 || rank >= tree->count) {
+        return -1;
+    }
+    int node = tree->root;
+    while (node != OSTREE_NIL) {
+        int left_size = node_size(tree, tree->nodes[node].left);
+        if (rank < left_size) {
+            node = tree->nodes[node].left;
+        } else if (rank == left_size) {
+            return node;
+        } else {
+            rank -= left_size + 1;
+            node = tree->nodes[node].right;
+        }
+    }
+    return -1;
+}
+
+int ostree_rank(const OSTree *tree, int item) {
+    int rank = 0;
+    int node = tree->root;
+    while (node != OSTREE_NIL) {
+        if (node == item) {
+            return rank + node_size(tree, tree->nodes[node].left);
+        }
+        if (item_less(tree, item, node)) {
+            node = tree->nodes[node].left;
+        } else {
+            rank += node_size(tree, tree->nodes[node].left) + 1;
+            node = tree->nodes[node].right;
+        }
+    }
+    return -1;
+}
+
+int ostree_count_before(const OSTree *tree, OSTreeProbe probe, const void *key, int inclusive) {
+    int count = 0;
+    int node = tree->root;
+    while (node != OSTREE_NIL) {
+        int c = probe(node, key, tree->ctx);
+        if (c < 0 || (inclusive && c == 0)) {
+            count += node_size(tree, tree->nodes[node].left) + 1;
+            node = tree->nodes[node].right;
+        } else {
+            node = tree->nodes[node].left;
+        }
+    }
+    return count;
+}
+
+static int iter_first_child(const OSTreeIter *iter, int node) {
+    return iter->reverse ? iter->tree->nodes[node].right : iter->tree->nodes[node].left;
+}
+
+static int iter_second_child(const OSTreeIter *iter, int node) {
+    return iter->reverse ? iter->tree->nodes[node].left : iter->tree->nodes[node].right;
+}
+
+static int iter_push(OSTreeIter *iter, int node) {
+    if (iter->depth == iter->capacity) {
+        int new_capacity = iter->capacity == 0 ? 64 : iter->capacity * 2;
+        int *stack = (int *)realloc(iter->stack, (size_t)new_capacity * sizeof(int));
+        if (!stack) {
+            return 1;
+        }
+        iter->stack = stack;
+        iter->capacity = new_capacity;
+    }
+    iter->stack[iter->depth++] = node;
+    return 0;
+}
+
+int ostree_iter_seek(OSTreeIter *iter, const OSTree *tree, int rank, int reverse) {
+    iter->tree = tree;
+    iter->depth = 0;
+    iter->reverse = reverse;
+    if (rank < 0 || rank >= tree->count) {
+        return 1;
+    }
+
+    // Ancestors still to be visited stay on the stack, just as a full in-order walk would leave them
+    int node = tree->root;
+    while (node != OSTREE_NIL) {
+        int first = iter_first_child(iter, node);
+        int first_size = node_size(tree, first);
+        if (rank < first_size) {
+            if (iter_push(iter, node) != 0) {
+                iter->depth = 0;
+                return 1;
+            }
+            node = first;
+        } else if (rank == first_size) {
+            if (iter_push(iter, node) != 0) {
+                iter->depth = 0;
+                return 1;
+            }
+            return 0;
+        } else {
+            rank -= first_size + 1;
+            node = iter_second_child(iter, node);
+        }
+    }
+    return 0;
+}
+
+int ostree_iter_next(OSTreeIter *iter) {
+    if (iter->depth == 0) {
+        return -1;
+    }
+    int node = iter->stack[--iter->depth];
+    for (int child = iter_second_child(iter, node); child != OSTREE_NIL; child = iter_first_child(iter, child)) {
+        if (iter_push(iter, child) != 0) {
+            iter->depth = 0; // out of memory: end the walk early rather than skip items
+            break;
+        }
+    }
+    return node;
+}
+
+void ostree_iter_free(OSTreeIter *iter) {
+    free(iter->stack);
+    iter->stack = NULL;
+    iter->depth = 0;
+    iter->capacity = 0;
+}
@@ -0,0 +1,72 @@
+#ifndef OSTREE_H
+#define OSTREE_H
+
+// Order-statistic treap over the items 0..count-1 of an external array.
+// Node i describes item i, so the node array mirrors the backing array: when an
+// element is removed from or inserted into the middle of that array, call
+// ostree_remove_slot / ostree_insert_slot to renumber the nodes the same way.
+// Items are ordered by cmp, ties by item number, which renumbering preserves.
+
+typedef int (*OSTreeCompare)(int a, int b, void *ctx);
+// Compares item with a search key, given the tree's ctx; must agree with the tree's order
+typedef int (*OSTreeProbe)(int item, const void *key, void *ctx);
+
+typedef struct {
+    int left;
+    int right;
+    int size;
+    unsigned priority;
+} OSTreeNode;
+
+typedef struct {
+    OSTreeNode *nodes;
+    int capacity;
+    int root;
+    int count;
+    unsigned seed;
+    OSTreeCompare cmp;
+    void *ctx;
+} OSTree;
+
+// In-order cursor; reverse walks from the largest item down
+typedef struct {
+    const OSTree *tree;
+    int *stack;
+    int depth;
+    int capacity;
+    int reverse;
+} OSTreeIter;
+
+void ostree_init(OSTree *tree, OSTreeCompare cmp, void *ctx);
+void ostree_free(OSTree *tree);
+int ostree_reserve(OSTree *tree, int capacity);
+
+// Insert items 0..count-1 into an empty tree in O(n log n)
+int ostree_build(OSTree *tree, int count);
+
+// item must not be in the tree yet and its key must already be readable through cmp
+int ostree_insert(OSTree *tree, int item);
+// Unlink item; its key must still be the one it was inserted with
+void ostree_erase(OSTree *tree, int item);
+
+// Mirror removing element item (already erased) from the backing array
+void ostree_remove_slot(OSTree *tree, int item);
+// Mirror inserting a new element at item; insert it afterwards with ostree_insert
+int ostree_insert_slot(OSTree *tree, int item);
+
+int ostree_size(const OSTree *tree);
+// Item at zero-based rank, or -1
+int ostree_select(const OSTree *tree, int rank);
+// Zero-based rank of item, or -1 when it is not in the tree
+int ostree_rank(const OSTree *tree, int item);
+// Number of items ordered before key (probe < 0), or not after it (probe <= 0) when inclusive,
+// so [count_before(key, 0), count_before(key, 1)) is the rank range of items equal to key
+int ostree_count_before(const OSTree *tree, OSTreeProbe probe, const void *key, int inclusive);
+
+// Position the cursor at rank (counted from the end when reverse) in O(log n)
+int ostree_iter_seek(OSTreeIter *iter, const OSTree *tree, int rank, int reverse);
+// Next item, or -1 when the walk is over
+int ostree_iter_next(OSTreeIter *iter);
+void ostree_iter_free(OSTreeIter *iter);
+
+#endif // OSTREE_H
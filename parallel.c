@@ -0,0 +1,296 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#define PARALLEL_DEQUE_SIZE 256
+
+typedef struct {
+    ParallelFn fn;
+    void *arg;
+    ParallelGroup *group;
+} PoolTask;
+
+// Ring of tasks; top and bottom only grow, bottom - top tasks are queued
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask tasks[PARALLEL_DEQUE_SIZE];
+    unsigned top;     // oldest task, taken by thieves
+    unsigned bottom;  // one past the newest, pushed and popped by the owner
+} PoolDeque;
+
+// Deque 0 is shared by threads outside the pool, deque i belongs to pool thread i
+static PoolDeque pool_deques[PARALLEL_MAX_THREADS];
+static pthread_key_t pool_self;     // deque index of the current pool thread, NULL (0) outside it
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;  // work queued or a group finished
+static int pool_started = 0;        // read atomically
+static int pool_threads = 0;        // threads including the callers' share, once started
+static int pool_queued = 0;         // tasks in all deques, updated atomically
+static int pool_sleepers = 0;       // threads waiting on pool_wake, under pool_lock
+static int configured_threads = 0;
+
+static int default_thread_count(void) {
+    const char *value = getenv(PARALLEL_THREADS_ENV);
+    if (value) {
+        char *endp = NULL;
+        long parsed = strtol(value, &endp, 10);
+        if (endp != value && *endp == '\0' && parsed >= 1 && parsed <= PARALLEL_MAX_THREADS) {
+            return (int)parsed;
+        }
+    }
+    long cores;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    cores = (long)info.dwNumberOfProcessors;
+#else
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cores < 1) {
+        return 1;
+    }
+    return cores > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int)cores;
+}
+
+int parallel_thread_count(void) {
+    if (__atomic_load_n(&pool_started, __ATOMIC_ACQUIRE)) {
+        return pool_threads;
+    }
+    pthread_mutex_lock(&pool_lock);
+    int threads = configured_threads;
+    pthread_mutex_unlock(&pool_lock);
+    return threads > 0 ? threads : default_thread_count();
+}
+
+int parallel_configure(int threads) {
+    if (threads < 0 || threads > PARALLEL_MAX_THREADS) {
+        return 1;
+    }
+    pthread_mutex_lock(&pool_lock);
+    int started = pool_started;
+    if (!started) {
+        configured_threads = threads;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return started;
+}
+
+static int deque_push(PoolDeque *deque, PoolTask task) {
+    pthread_mutex_lock(&deque->lock);
+    int full = deque->bottom - deque->top == PARALLEL_DEQUE_SIZE;
+    if (!full) {
+        deque->tasks[deque->bottom++ % PARALLEL_DEQUE_SIZE] = task;
+        __atomic_add_fetch(&pool_queued, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return full ? 1 : 0;
+}
+
+// Newest task for the owner, oldest for a thief
+static int deque_take(PoolDeque *deque, int steal, PoolTask *out) {
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->bottom != deque->top;
+    if (found) {
+        *out = steal ? deque->tasks[deque->top++ % PARALLEL_DEQUE_SIZE]
+                     : deque->tasks[--deque->bottom % PARALLEL_DEQUE_SIZE];
+        __atomic_sub_fetch(&pool_queued, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static int current_deque(void) {
+    return (int)(intptr_t)pthread_getspecific(pool_self);
+}
+
+// Own deque first, then steal round-robin from the others
+static int find_task(int self, PoolTask *out) {
+    if (deque_take(&pool_deques[self], 0, out)) {
+        return 1;
+    }
+    for (int i = 1; i < pool_threads; i++) {
+        if (deque_take(&pool_deques[(self + i) % pool_threads], 1, out)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void task_done(ParallelGroup *group) {
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool_lock);
+        pthread_cond_broadcast(&pool_wake);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+static void run_task(PoolTask task) {
+    task.fn(task.arg);
+    task_done(task.group);
+}
+
+// Sleep until a task is queued or, with group, until group has finished
+static void pool_sleep(ParallelGroup *group) {
+    pthread_mutex_lock(&pool_lock);
+    while (__atomic_load_n(&pool_queued, __ATOMIC_RELAXED) == 0 &&
+           (!group || __atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0)) {
+        pool_sleepers++;
+        pthread_cond_wait(&pool_wake, &pool_lock);
+        pool_sleepers--;
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void *pool_worker(void *arg) {
+    int self = (int)(intptr_t)arg;
+    pthread_setspecific(pool_self, arg);
+    for (;;) {
+        PoolTask task;
+        if (find_task(self, &task)) {
+            run_task(task);
+        } else {
+            pool_sleep(NULL);
+        }
+    }
+    return NULL;
+}
+
+// Start the pool's threads on first use, with every signal blocked so signals keep going
+// to the UI thread
+static void parallel_start(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (!pool_started) {
+        int threads = configured_threads > 0 ? configured_threads : default_thread_count();
+        pthread_key_create(&pool_self, NULL);
+        for (int i = 0; i < threads; i++) {
+            pthread_mutex_init(&pool_deques[i].lock, NULL);
+        }
+#ifndef _WIN32
+        sigset_t all;
+        sigset_t previous;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &previous);
+#endif
+        // A thread that fails to start leaves its deque unused; the others do its share
+        pool_threads = threads;
+        for (int i = 1; i < threads; i++) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, pool_worker, (void *)(intptr_t)i) == 0) {
+                pthread_detach(thread);
+            }
+        }
+#ifndef _WIN32
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+#endif
+        __atomic_store_n(&pool_started, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void parallel_group_init(ParallelGroup *group) {
+    group->pending = 0;
+}
+
+void parallel_spawn(ParallelGroup *group, ParallelFn fn, void *arg) {
+    if (!__atomic_load_n(&pool_started, __ATOMIC_ACQUIRE)) {
+        parallel_start();
+    }
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    PoolTask task = {fn, arg, group};
+    if (pool_threads == 1 || deque_push(&pool_deques[current_deque()], task) != 0) {
+        run_task(task);
+        return;
+    }
+    pthread_mutex_lock(&pool_lock);
+    if (pool_sleepers > 0) {
+        pthread_cond_broadcast(&pool_wake);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void parallel_wait(ParallelGroup *group) {
+    if (!__atomic_load_n(&pool_started, __ATOMIC_ACQUIRE)) {
+        return; // nothing was ever spawned
+    }
+    int self = current_deque();
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        PoolTask task;
+        if (find_task(self, &task)) {
+            run_task(task);
+        } else {
+            pool_sleep(group);
+        }
+    }
+}
+
+int parallel_partitions(int count, int min_part) {
+    if (min_part < 1) {
+        min_part = 1;
+    }
+    int parts = count / min_part;
+    int threads = parallel_thread_count();
+    if (parts > threads) {
+        parts = threads;
+    }
+    return parts > 1 ? parts : 1;
+}
+
+void parallel_part_range(int count, int parts, int part, int *begin, int *end) {
+    *begin = (int)((long long)count * part / parts);
+    *end = (int)((long long)count * (part + 1) / parts);
+}
+
+// Parts [first, last) of a parallel_for: the upper half is spawned, the lower half run here
+typedef struct {
+    ParallelTask task;
+    void *ctx;
+    int count;
+    int parts;
+    int first;
+    int last;
+} PartSpan;
+
+static void run_part_span(void *arg) {
+    PartSpan *span = (PartSpan *)arg;
+    if (span->last - span->first == 1) {
+        int begin;
+        int end;
+        parallel_part_range(span->count, span->parts, span->first, &begin, &end);
+        span->task(span->first, begin, end, span->ctx);
+        return;
+    }
+    int middle = span->first + (span->last - span->first) / 2;
+    PartSpan upper = *span;
+    PartSpan lower = *span;
+    upper.first = middle;
+    lower.last = middle;
+    ParallelGroup group;
+    parallel_group_init(&group);
+    parallel_spawn(&group, run_part_span, &upper);
+    run_part_span(&lower);
+    parallel_wait(&group);
+}
+
+void parallel_for(int count, int parts, ParallelTask task, void *ctx) {
+    if (count <= 0) {
+        return;
+    }
+    PartSpan span = {task, ctx, count, parts > 1 ? parts : 1, 0, parts > 1 ? parts : 1};
+    run_part_span(&span);
+}
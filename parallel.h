@@ -0,0 +1,50 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Work-stealing thread pool shared by loading, saving and scanning the catalog.
+// Each pool thread owns a deque of tasks: it pushes and pops the newest end, and idle
+// threads steal the oldest task of another deque. Threads outside the pool share one extra
+// deque. Tasks are spawned into a group, and waiting on a group runs queued tasks (its own
+// or anybody's) until every task of the group is done, so tasks may spawn and wait too.
+//
+// The pool starts on first use with parallel_thread_count() threads, the caller included.
+
+#define PARALLEL_MAX_THREADS 64
+#define PARALLEL_THREADS_ENV "POM_THREADS"
+
+typedef void (*ParallelFn)(void *arg);
+
+// Tasks not finished yet; initialise with parallel_group_init
+typedef struct {
+    int pending;
+} ParallelGroup;
+
+// Threads a job can use, the caller included: the count given to parallel_configure, else
+// POM_THREADS, else one per core
+int parallel_thread_count(void);
+
+// Choose the thread count (1 to PARALLEL_MAX_THREADS, 0 for the default) before the pool
+// starts; returns 1 for an invalid count or once the pool is running
+int parallel_configure(int threads);
+
+void parallel_group_init(ParallelGroup *group);
+// Queue fn(arg) in group; runs it at once when the pool has no other thread or the deque is full
+void parallel_spawn(ParallelGroup *group, ParallelFn fn, void *arg);
+// Help run queued tasks until every task of group has finished
+void parallel_wait(ParallelGroup *group);
+
+// part covers items [begin, end)
+typedef void (*ParallelTask)(int part, int begin, int end, void *ctx);
+
+// Parts to split count items into so that each holds at least min_part of them;
+// 1 (run on the caller alone) for small counts
+int parallel_partitions(int count, int min_part);
+
+// Item range of part out of parts for count items; parts are numbered in item order, so
+// per-part results concatenated by part number come out in item order
+void parallel_part_range(int count, int parts, int part, int *begin, int *end);
+
+// Run task on each of parts parts of [0, count) and wait for all of them
+void parallel_for(int count, int parts, ParallelTask task, void *ctx);
+
+#endif // PARALLEL_H
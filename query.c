@@ -0,0 +1,257 @@
+#include "query.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void copy_lower(char *dst, const char *src) {
+    size_t i = 0;
+    for (; src[i] && i < QUERY_TEXT_MAX - 1; i++) {
+        dst[i] = (char)tolower((unsigned char)src[i]);
+    }
+    dst[i] = '\0';
+}
+
+// Next space-separated token with double quotes removed; returns NULL at the end of text
+static const char *next_token(const char *text, char *token, size_t size, int *quoted) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    if (*text == '\0') {
+        return NULL;
+    }
+    *quoted = *text == '"';
+    int in_quotes = 0;
+    size_t len = 0;
+    for (; *text && (in_quotes || (*text != ' ' && *text != '\t')); text++) {
+        if (*text == '"') {
+            in_quotes = !in_quotes;
+            continue;
+        }
+        if (len + 1 < size) {
+            token[len++] = *text;
+        }
+    }
+    token[len] = '\0';
+    return text;
+}
+
+static int field_is(const char *name, size_t len, const char *field) {
+    if (strlen(field) != len) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)name[i]) != field[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int parse_int(const char *text, int *out) {
+    if (*text == '\0') {
+        return 1;
+    }
+    char *end = NULL;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || *end != '\0' || value < INT_MIN || value > INT_MAX) {
+        return 1;
+    }
+    *out = (int)value;
+    return 0;
+}
+
+// Inclusive range of values satisfying "x op value"; an empty range comes back as low > high
+static void numeric_range(const char *op, int value, int *low, int *high) {
+    *low = INT_MIN;
+    *high = INT_MAX;
+    if (strcmp(op, "<") == 0) {
+        if (value == INT_MIN) {
+            *low = 1;
+            *high = 0;
+        } else {
+            *high = value - 1;
+        }
+    } else if (strcmp(op, "<=") == 0) {
+        *high = value;
+    } else if (strcmp(op, ">") == 0) {
+        if (value == INT_MAX) {
+            *low = 1;
+            *high = 0;
+        } else {
+            *low = value + 1;
+        }
+    } else if (strcmp(op, ">=") == 0) {
+        *low = value;
+    } else {
+        *low = value;
+        *high = value;
+    }
+}
+
+// Fill term from "field op value"; returns 1 when token is not a field test, -1 to skip it
+static int parse_field_test(const char *token, QueryTerm *term) {
+    size_t name_len = 0;
+    while (isalpha((unsigned char)token[name_len])) {
+        name_len++;
+    }
+    const char *rest = token + name_len;
+    char op[3] = {0};
+    if ((rest[0] == '<' || rest[0] == '>') && rest[1] == '=') {
+        op[0] = rest[0];
+        op[1] = '=';
+    } else if (rest[0] == '<' || rest[0] == '>' || rest[0] == '=' || rest[0] == ':') {
+        op[0] = rest[0];
+    } else {
+        return 1;
+    }
+    const char *value = rest + strlen(op);
+    int ordered = op[0] == '<' || op[0] == '>';
+
+    if (field_is(token, name_len, "qty") || field_is(token, name_len, "quantity") ||
+        field_is(token, name_len, "price") || field_is(token, name_len, "unitprice")) {
+        if (*value == '\0') {
+            return -1;
+        }
+        int number = 0;
+        if (parse_int(value, &number) != 0) {
+            return 1;
+        }
+        term->field = (token[0] == 'q' || token[0] == 'Q') ? QUERY_QUANTITY : QUERY_PRICE;
+        numeric_range(op, number, &term->low, &term->high);
+        return 0;
+    }
+    if (field_is(token, name_len, "id") && !ordered) {
+        if (*value == '\0') {
+            return -1;
+        }
+        term->field = op[0] == '=' ? QUERY_ID_EXACT : QUERY_ID_PREFIX;
+        copy_lower(term->text, value);
+        return 0;
+    }
+    if (field_is(token, name_len, "name") && !ordered) {
+        if (*value == '\0') {
+            return -1;
+        }
+        term->field = QUERY_NAME;
+        copy_lower(term->text, value);
+        return 0;
+    }
+    return 1;
+}
+
+// "text~" or "text~N": fill a fuzzy term and return 0, or 1 when token has no such suffix
+static int parse_fuzzy(const char *token, QueryTerm *term) {
+    const char *tilde = strrchr(token, '~');
+    if (!tilde || tilde == token || strlen(tilde) > 2 || (tilde[1] && !isdigit((unsigned char)tilde[1]))) {
+        return 1;
+    }
+    size_t length = (size_t)(tilde - token);
+    if (length > QUERY_TEXT_MAX - 1) {
+        length = QUERY_TEXT_MAX - 1;
+    }
+    int edits = tilde[1] ? tilde[1] - '0' : (length <= 2 ? 0 : length <= 5 ? 1 : 2);
+    if (edits > QUERY_FUZZY_MAX_EDITS) {
+        edits = QUERY_FUZZY_MAX_EDITS;
+    }
+    if (edits >= (int)length) {
+        edits = (int)length - 1; // otherwise every row would match
+    }
+    memset(term, 0, sizeof(*term));
+    term->field = QUERY_FUZZY;
+    term->max_edits = edits;
+    for (size_t i = 0; i < length; i++) {
+        term->text[i] = (char)tolower((unsigned char)token[i]);
+    }
+    return 0;
+}
+
+static void copy_raw(char *dst, const char *src, size_t length) {
+    if (length > QUERY_TEXT_MAX - 1) {
+        length = QUERY_TEXT_MAX - 1;
+    }
+    memcpy(dst, src, length);
+    dst[length] = '\0';
+}
+
+// Fill term from one token; returns -1 when the token adds no term
+static int parse_token(const char *token, int quoted, QueryTerm *term) {
+    int parsed = quoted ? 1 : parse_field_test(token, term);
+    if (parsed <= 0) {
+        return parsed;
+    }
+    if (token[0] == '\0') {
+        return -1; // ""
+    }
+    if (!quoted) {
+        size_t length = strlen(token);
+        if (length > 2 && token[0] == '/' && token[length - 1] == '/') {
+            memset(term, 0, sizeof(*term));
+            term->field = QUERY_REGEX;
+            copy_raw(term->text, token + 1, length - 2); // escapes like \D are case-sensitive
+            return 0;
+        }
+        if (strpbrk(token, "*?")) {
+            memset(term, 0, sizeof(*term));
+            term->field = QUERY_GLOB;
+            copy_raw(term->text, token, length);
+            return 0;
+        }
+        if (parse_fuzzy(token, term) == 0) {
+            return 0;
+        }
+    }
+    memset(term, 0, sizeof(*term));
+    term->field = QUERY_TEXT;
+    copy_lower(term->text, token);
+    return 0;
+}
+
+int query_parse(const char *text, Query *query) {
+    memset(query, 0, sizeof(*query));
+    char token[256];
+    int quoted = 0;
+    while (query->term_count < QUERY_MAX_TERMS &&
+           (text = next_token(text, token, sizeof(token), &quoted)) != NULL) {
+        if (parse_token(token, quoted, &query->terms[query->term_count]) == 0) {
+            query->term_count++;
+        }
+    }
+    return query->term_count;
+}
+
+int query_make_fuzzy(const char *text, char *out, size_t size) {
+    size_t used = 0;
+    char token[256];
+    int quoted = 0;
+    const char *start = text;
+    const char *end;
+    while ((end = next_token(start, token, sizeof(token), &quoted)) != NULL) {
+        while (*start == ' ' || *start == '\t') {
+            start++;
+        }
+        QueryTerm term;
+        int plain = !quoted && parse_token(token, quoted, &term) == 0 && term.field == QUERY_TEXT;
+        size_t length = (size_t)(end - start);
+        if (used + length + 3 > size) {
+            return 1;
+        }
+        if (used > 0) {
+            out[used++] = ' ';
+        }
+        memcpy(out + used, start, length);
+        used += length;
+        if (plain) {
+            out[used++] = '~';
+        }
+        start = end;
+    }
+    if (size == 0) {
+        return 1;
+    }
+    out[used] = '\0';
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+
+// Query language of the product list filter. Terms are separated by spaces and must all match:
+//   mouse  "usb cable"   ProductID or ProductName contains the text
+//   name:mouse           ProductName contains the text
+//   id:B00  id=B0012     ProductID starts with / equals the text
+//   qty<5  price>=1000   Quantity / UnitPrice compared with <, <=, >, >= or = (':' means =)
+//   keybaord~  mose~1    ProductID or ProductName contains the text with at most N typos
+//                        (default 1 for up to 5 characters, 2 above; 0 for 1-2 characters)
+//   /kb-\d+$/            ProductID or ProductName matches the regular expression (see dfa.h)
+//   ELEC-*  ?001         the whole ProductID or ProductName matches the glob
+// Text is case-insensitive. A field test with an empty value is skipped so a half-typed
+// query still lists everything; anything else that does not parse is matched as text.
+
+typedef enum {
+    QUERY_TEXT,
+    QUERY_NAME,
+    QUERY_ID_PREFIX,
+    QUERY_ID_EXACT,
+    QUERY_QUANTITY,
+    QUERY_PRICE,
+    QUERY_FUZZY,
+    QUERY_REGEX,
+    QUERY_GLOB
+} QueryField;
+
+#define QUERY_MAX_TERMS 16
+#define QUERY_TEXT_MAX 64
+#define QUERY_FUZZY_MAX_EDITS 3
+
+typedef struct {
+    QueryField field;
+    char text[QUERY_TEXT_MAX]; // text fields only; lowercased except regex and glob patterns
+    int low;                   // inclusive range; numeric fields only, empty when low > high
+    int high;
+    int max_edits;             // QUERY_FUZZY only
+} QueryTerm;
+
+typedef struct {
+    QueryTerm terms[QUERY_MAX_TERMS];
+    int term_count;
+} Query;
+
+// Parse text into query; terms past QUERY_MAX_TERMS are ignored. Returns the term count.
+int query_parse(const char *text, Query *query);
+
+// Copy text to out with every plain text term made fuzzy ("mouse" becomes "mouse~"); quoted
+// text and field tests are left exact. Returns 1 when out is too small.
+int query_make_fuzzy(const char *text, char *out, size_t size);
+
+#endif // QUERY_H
@@ -0,0 +1,57 @@
+#include "rwlock.h"
+
+void rwlock_init(RwLock *rw) {
+    pthread_mutex_init(&rw->lock, NULL);
+    pthread_cond_init(&rw->changed, NULL);
+    rw->readers = 0;
+    rw->writing = 0;
+    rw->writers_waiting = 0;
+}
+
+void rwlock_destroy(RwLock *rw) {
+    pthread_cond_destroy(&rw->changed);
+    pthread_mutex_destroy(&rw->lock);
+}
+
+void rwlock_read_lock(RwLock *rw) {
+    pthread_mutex_lock(&rw->lock);
+    while (rw->writing || rw->writers_waiting > 0) {
+        pthread_cond_wait(&rw->changed, &rw->lock);
+    }
+    rw->readers++;
+    pthread_mutex_unlock(&rw->lock);
+}
+
+void rwlock_read_unlock(RwLock *rw) {
+    pthread_mutex_lock(&rw->lock);
+    if (--rw->readers == 0) {
+        pthread_cond_broadcast(&rw->changed);
+    }
+    pthread_mutex_unlock(&rw->lock);
+}
+
+void rwlock_write_lock(RwLock *rw) {
+    pthread_mutex_lock(&rw->lock);
+    rw->writers_waiting++;
+    while (rw->writing || rw->readers > 0) {
+        pthread_cond_wait(&rw->changed, &rw->lock);
+    }
+    rw->writers_waiting--;
+    rw->writing = 1;
+    pthread_mutex_unlock(&rw->lock);
+}
+
+void rwlock_write_unlock(RwLock *rw) {
+    pthread_mutex_lock(&rw->lock);
+    rw->writing = 0;
+    pthread_cond_broadcast(&rw->changed);
+    pthread_mutex_unlock(&rw->lock);
+}
+
+void rwlock_downgrade(RwLock *rw) {
+    pthread_mutex_lock(&rw->lock);
+    rw->writing = 0;
+    rw->readers++;
+    pthread_cond_broadcast(&rw->changed);
+    pthread_mutex_unlock(&rw->lock);
+}
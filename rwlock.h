@@ -0,0 +1,33 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include <pthread.h>
+
+// Writer-preferring reader/writer lock. Any number of readers share it; a writer waits for
+// them to leave and holds it alone. Once a writer is waiting no new reader gets in, so a
+// steady stream of queries cannot starve a commit. A writer can downgrade to a reader
+// without letting another writer in between, e.g. to save what it just changed while
+// queries run again. Not recursive: a thread must not lock it twice.
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;   // broadcast whenever the lock is released or downgraded
+    int readers;
+    int writing;
+    int writers_waiting;
+} RwLock;
+
+#define RWLOCK_INITIALIZER {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0}
+
+// For locks not initialised with RWLOCK_INITIALIZER
+void rwlock_init(RwLock *rw);
+void rwlock_destroy(RwLock *rw);
+
+void rwlock_read_lock(RwLock *rw);
+void rwlock_read_unlock(RwLock *rw);
+void rwlock_write_lock(RwLock *rw);
+void rwlock_write_unlock(RwLock *rw);
+// Turn the caller's write lock into a read lock
+void rwlock_downgrade(RwLock *rw);
+
+#endif // RWLOCK_H
@@ -0,0 +1,375 @@
+#include "screen.h"
+#include "helpers.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+typedef struct {
+    char *text;          // lines stored back to back, each NUL-terminated
+    size_t len;
+    size_t cap;
+    size_t *starts;      // offset of every line inside text
+    int count;
+    int line_cap;
+    int line_open;       // last line still receives text
+    int scroll_first;    // rows that move together when paging, -1 if none
+    int scroll_last;
+} ScreenFrame;
+
+static ScreenFrame g_frames[2];
+static int g_current = 0;
+static int g_previous_valid = 0;
+static int g_below_dirty = 0;  // text under the last frame since its cursor was parked
+
+// Bytes for the terminal, flushed once per frame
+static char *g_out = NULL;
+static size_t g_out_len = 0;
+static size_t g_out_cap = 0;
+static ScreenStats g_stats;
+
+static void out_append(const char *text, size_t len) {
+    if (g_out_len + len > g_out_cap) {
+        size_t new_cap = g_out_cap ? g_out_cap : 8192;
+        while (new_cap < g_out_len + len) {
+            new_cap *= 2;
+        }
+        char *grown = (char *)realloc(g_out, new_cap);
+        if (!grown) {
+            return;
+        }
+        g_out = grown;
+        g_out_cap = new_cap;
+    }
+    memcpy(g_out + g_out_len, text, len);
+    g_out_len += len;
+}
+
+static void out_puts(const char *text) {
+    out_append(text, strlen(text));
+}
+
+static void out_printf(const char *fmt, ...) {
+    char buf[64];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len > 0) {
+        out_append(buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+    }
+}
+
+// Emit a frame line cut to the terminal width so it never wraps onto the next row.
+// Escape sequences take no room and a UTF-8 sequence counts as one column.
+static void out_line_clipped(const char *line, int cols) {
+    const char *p = line;
+    int width = 0;
+    while (*p) {
+        if (*p == '\033') {
+            const char *seq = p++;
+            if (*p == '[') {
+                p++;
+                while (*p && !(*p >= 0x40 && *p <= 0x7E)) {
+                    p++;
+                }
+            }
+            if (*p) {
+                p++;
+            }
+            out_append(seq, (size_t)(p - seq));
+            continue;
+        }
+        if (((unsigned char)*p & 0xC0) != 0x80) {
+            if (width == cols) {
+                out_puts("\033[0m");
+                return;
+            }
+            width++;
+        }
+        out_append(p, 1);
+        p++;
+    }
+}
+
+static void out_flush(void) {
+    unsigned long syscalls = 0;
+    size_t written = 0;
+
+    while (written < g_out_len) {
+        long rc = terminal_write(g_out + written, g_out_len - written);
+        syscalls++;
+        if (rc <= 0) {
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += (size_t)rc;
+    }
+
+    g_stats.frames++;
+    g_stats.bytes += written;
+    g_stats.syscalls += syscalls;
+    g_stats.last_bytes = (unsigned long)written;
+    g_stats.last_syscalls = syscalls;
+    g_out_len = 0;
+}
+
+static int frame_reserve(ScreenFrame *frame, size_t extra) {
+    if (frame->len + extra <= frame->cap) {
+        return 0;
+    }
+    size_t new_cap = frame->cap ? frame->cap : 4096;
+    while (new_cap < frame->len + extra) {
+        new_cap *= 2;
+    }
+    char *grown = (char *)realloc(frame->text, new_cap);
+    if (!grown) {
+        return 1;
+    }
+    frame->text = grown;
+    frame->cap = new_cap;
+    return 0;
+}
+
+static int frame_open_line(ScreenFrame *frame) {
+    if (frame->count == frame->line_cap) {
+        int new_cap = frame->line_cap ? frame->line_cap * 2 : 64;
+        size_t *grown = (size_t *)realloc(frame->starts, (size_t)new_cap * sizeof(size_t));
+        if (!grown) {
+            return 1;
+        }
+        frame->starts = grown;
+        frame->line_cap = new_cap;
+    }
+    if (frame_reserve(frame, 1) != 0) {
+        return 1;
+    }
+    frame->starts[frame->count++] = frame->len;
+    frame->text[frame->len++] = '\0';
+    frame->line_open = 1;
+    return 0;
+}
+
+static void frame_append(ScreenFrame *frame, const char *text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (!frame->line_open && frame_open_line(frame) != 0) {
+            return;
+        }
+        if (text[i] == '\n') {
+            frame->line_open = 0;
+            continue;
+        }
+        if (frame_reserve(frame, 1) != 0) {
+            return;
+        }
+        // Overwrite the terminating NUL, then terminate again
+        frame->text[frame->len - 1] = text[i];
+        frame->text[frame->len++] = '\0';
+    }
+}
+
+static const char *frame_line(const ScreenFrame *frame, int index) {
+    return frame->text + frame->starts[index];
+}
+
+void screen_begin_frame(void) {
+    ScreenFrame *frame = &g_frames[g_current];
+    frame->len = 0;
+    frame->count = 0;
+    frame->line_open = 0;
+    frame->scroll_first = -1;
+    frame->scroll_last = -1;
+}
+
+void screen_printf(const char *fmt, ...) {
+    char stack_buf[512];
+    va_list args;
+
+    va_start(args, fmt);
+    int needed = vsnprintf(stack_buf, sizeof(stack_buf), fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return;
+    }
+
+    ScreenFrame *frame = &g_frames[g_current];
+    if ((size_t)needed < sizeof(stack_buf)) {
+        frame_append(frame, stack_buf, (size_t)needed);
+        return;
+    }
+
+    char *heap_buf = (char *)malloc((size_t)needed + 1);
+    if (!heap_buf) {
+        return;
+    }
+    va_start(args, fmt);
+    vsnprintf(heap_buf, (size_t)needed + 1, fmt, args);
+    va_end(args);
+    frame_append(frame, heap_buf, (size_t)needed);
+    free(heap_buf);
+}
+
+// Index of the line the next screen_printf() output lands on
+int screen_current_line(void) {
+    const ScreenFrame *frame = &g_frames[g_current];
+    return frame->line_open ? frame->count - 1 : frame->count;
+}
+
+// Declare rows [first_line, last_line] as a list that may scroll by one row between frames
+void screen_mark_scroll_region(int first_line, int last_line) {
+    ScreenFrame *frame = &g_frames[g_current];
+    frame->scroll_first = first_line;
+    frame->scroll_last = last_line;
+}
+
+void screen_invalidate(void) {
+    g_previous_valid = 0;
+}
+
+void screen_mark_below_dirty(void) {
+    g_below_dirty = 1;
+}
+
+static int lines_equal(const char *a, const char *b) {
+    return a && b && strcmp(a, b) == 0;
+}
+
+// Move rows inside the region with the terminal itself when the list moved by exactly one row.
+// Returns the applied shift: 1 for content moving up, -1 for down, 0 when not worth it.
+static int emit_scroll(const ScreenFrame *next, const char **shown, int shown_count) {
+    const ScreenFrame *prev = &g_frames[1 - g_current];
+    int first = next->scroll_first;
+    int last = next->scroll_last;
+    if (first < 0 || last - first < 2 ||
+        prev->scroll_first != first || prev->scroll_last != last ||
+        last >= next->count || last >= shown_count) {
+        return 0;
+    }
+
+    int same = 0;
+    int up = 0;
+    int down = 0;
+    for (int i = first; i <= last; i++) {
+        const char *line = frame_line(next, i);
+        same += lines_equal(line, shown[i]);
+        if (i < last) {
+            up += lines_equal(line, shown[i + 1]);
+        }
+        if (i > first) {
+            down += lines_equal(line, shown[i - 1]);
+        }
+    }
+
+    int shift = 0;
+    if (up >= down && up >= same + 2) {
+        shift = 1;
+    } else if (down > up && down >= same + 2) {
+        shift = -1;
+    }
+    if (shift == 0) {
+        return 0;
+    }
+
+    out_printf("\033[%d;%dr", first + 1, last + 1);
+    if (shift == 1) {
+        out_printf("\033[%d;1H\n", last + 1);      // line feed at the bottom margin scrolls up
+        memmove(&shown[first], &shown[first + 1], (size_t)(last - first) * sizeof(shown[0]));
+        shown[last] = "";
+    } else {
+        out_printf("\033[%d;1H\033M", first + 1);  // reverse index at the top margin scrolls down
+        memmove(&shown[first + 1], &shown[first], (size_t)(last - first) * sizeof(shown[0]));
+        shown[first] = "";
+    }
+    out_puts("\033[r");
+    return shift;
+}
+
+static void emit_full(const ScreenFrame *frame, int interactive) {
+    if (interactive) {
+        out_puts("\033[2J\033[H");
+    } else {
+        clear_screen(); // lets test hooks see the screen change
+        fflush(stdout);
+    }
+    int cols = interactive ? get_terminal_cols() : 0;
+    for (int i = 0; i < frame->count; i++) {
+        if (cols > 0) {
+            out_line_clipped(frame_line(frame, i), cols);
+        } else {
+            out_puts(frame_line(frame, i));
+        }
+        out_append("\n", 1);
+    }
+}
+
+static void emit_diff(const ScreenFrame *next) {
+    const ScreenFrame *prev = &g_frames[1 - g_current];
+    int shown_count = prev->count > next->count ? prev->count : next->count;
+    const char **shown = (const char **)malloc((size_t)(shown_count + 1) * sizeof(char *));
+    if (!shown) {
+        emit_full(next, 1);
+        return;
+    }
+    for (int i = 0; i < shown_count; i++) {
+        shown[i] = i < prev->count ? frame_line(prev, i) : "";
+    }
+
+    emit_scroll(next, shown, prev->count);
+
+    int cols = get_terminal_cols();
+    for (int i = 0; i < shown_count; i++) {
+        const char *line = i < next->count ? frame_line(next, i) : "";
+        if (lines_equal(line, shown[i])) {
+            continue;
+        }
+        out_printf("\033[%d;1H", i + 1);
+        out_line_clipped(line, cols);
+        out_puts("\033[K");
+    }
+    // Park the cursor below the frame and drop whatever prompts printed there last time.
+    // A frame identical to the one shown, with nothing typed under it, writes nothing at all.
+    if (g_out_len > 0 || g_below_dirty) {
+        out_printf("\033[%d;1H\033[J", next->count + 1);
+        g_below_dirty = 0;
+    }
+    free(shown);
+}
+
+void screen_end_frame(void) {
+    ScreenFrame *frame = &g_frames[g_current];
+
+    fflush(stdout); // text printed before the frame must reach the terminal first
+    g_out_len = 0;
+
+    if (!terminal_is_interactive()) {
+        // Scripted runs and redirected output get every frame in full, one after another
+        emit_full(frame, 0);
+        g_previous_valid = 0;
+    } else if (!g_previous_valid) {
+        emit_full(frame, 1);
+        g_previous_valid = 1;
+        g_below_dirty = 0;
+    } else {
+        emit_diff(frame);
+    }
+    out_flush();
+
+    if (g_previous_valid) {
+        g_current = 1 - g_current;
+    }
+}
+
+void screen_get_stats(ScreenStats *out) {
+    if (out) {
+        *out = g_stats;
+    }
+}
+
+void screen_reset_stats(void) {
+    memset(&g_stats, 0, sizeof(g_stats));
+}
@@ -0,0 +1,28 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+// Frame-based rendering for full-screen menus.
+// A frame is composed line by line with screen_printf(); screen_end_frame() compares it
+// with the previously drawn frame, builds the escape sequences for the lines that changed
+// in one memory buffer and hands it to the terminal with a single write.
+
+typedef struct {
+    unsigned long frames;          // frames flushed since the last reset
+    unsigned long long bytes;      // bytes written for those frames
+    unsigned long syscalls;        // write calls issued for those frames
+    unsigned long last_bytes;      // bytes of the most recent frame
+    unsigned long last_syscalls;   // write calls of the most recent frame
+} ScreenStats;
+
+void screen_begin_frame(void);
+void screen_printf(const char *fmt, ...);
+void screen_mark_scroll_region(int first_line, int last_line);
+int screen_current_line(void);
+void screen_end_frame(void);
+void screen_invalidate(void);
+// Prompts or echoed input went below the frame: the next frame clears it even if nothing else changed
+void screen_mark_below_dirty(void);
+void screen_get_stats(ScreenStats *out);
+void screen_reset_stats(void);
+
+#endif // SCREEN_H